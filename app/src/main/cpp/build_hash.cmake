@@ -0,0 +1,12 @@
+# Writes build_hash.h with the current git revision.
+# Runs on every build through the featuretest_build_hash target; configure_file leaves the
+# header untouched when the revision didn't change, so nothing is recompiled then.
+#   cmake -DSOURCE_DIR=<repo dir> -DOUTPUT=<header> -P build_hash.cmake
+execute_process(
+    COMMAND git rev-parse --short HEAD
+    WORKING_DIRECTORY ${SOURCE_DIR}
+    OUTPUT_VARIABLE FEATURETEST_BUILD_HASH
+    OUTPUT_STRIP_TRAILING_WHITESPACE
+    ERROR_QUIET
+)
+configure_file(${CMAKE_CURRENT_LIST_DIR}/build_hash.h.in ${OUTPUT} @ONLY)
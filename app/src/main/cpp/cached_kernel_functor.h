@@ -0,0 +1,83 @@
+#pragma once
+
+#include "opencl_test.h"
+
+#include <cstring>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Drop-in for cl::KernelFunctor in hot loops.
+// cl::KernelFunctor calls clSetKernelArg for every argument on every launch. This one
+// remembers what was bound last time and only sets arguments whose value changed.
+// Memory objects are compared by handle; the cache keeps a reference to them, so a
+// released buffer can't be replaced by a new one reusing the same handle.
+// Like cl::KernelFunctor it is not meant to be shared between threads.
+template<typename... Ts>
+class CachedKernelFunctor {
+private:
+    cl::Kernel kernel_;
+    std::tuple<std::optional<std::decay_t<Ts>>...> bound_;
+    size_t setArgCalls_ = 0;
+
+    template<class T>
+    static bool SameArg(const T& a, const T& b) {
+        if constexpr (std::is_base_of_v<cl::Memory, T> || std::is_same_v<T, cl::Sampler>) {
+            return a() == b();
+        } else {
+            static_assert(std::is_trivially_copyable_v<T>, "kernel argument must be a cl object or plain data");
+            return std::memcmp(&a, &b, sizeof(T)) == 0;
+        }
+    }
+
+    template<size_t index, class T>
+    void bindArg(const T& value) {
+        auto& slot = std::get<index>(bound_);
+        if (slot && SameArg(*slot, value))
+            return;
+        kernel_.setArg((cl_uint)index, value);
+        slot = value;
+        ++setArgCalls_;
+    }
+
+    template<size_t... Is>
+    void bindArgs(std::index_sequence<Is...>, const Ts&... ts) {
+        (bindArg<Is>(ts), ...);
+    }
+
+public:
+    CachedKernelFunctor(cl::Kernel kernel) : kernel_(kernel) {}
+
+    CachedKernelFunctor(const cl::Program& program, const std::string& name)
+        : kernel_(program, name.c_str()) {}
+
+    cl::Event operator() (
+        const cl::CommandQueue& queue,
+        const cl::NDRange& global,
+        const cl::NDRange& local,
+        Ts... ts)
+    {
+        cl::Event event;
+        bindArgs(std::index_sequence_for<Ts...>{}, ts...);
+        queue.enqueueNDRangeKernel(kernel_, cl::NullRange, global, local, nullptr, &event);
+        return event;
+    }
+
+    cl::Event operator() (
+        const cl::CommandQueue& queue,
+        const cl::NDRange& global,
+        Ts... ts)
+    {
+        return (*this)(queue, global, cl::NullRange, ts...);
+    }
+
+    // Forget the bound values, e.g. after the kernel object was touched by other code.
+    void invalidate() {
+        bound_ = {};
+    }
+
+    size_t setArgCalls() const { return setArgCalls_; }
+
+    cl::Kernel getKernel() { return kernel_; }
+};
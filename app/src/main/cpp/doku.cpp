@@ -1,5 +1,7 @@
 #include "doku.h"
 #include "doku.h"
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 
 #ifdef __ANDROID__
@@ -7,9 +9,11 @@
     #include <android/native_window.h>
     #define LOG_TAG "DOKU_RENDER"
     #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+    #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #else
     #include <cstdio>
     #define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+    #define LOGI(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
 #endif
 
 
@@ -21,13 +25,16 @@ GLEnv::~GLEnv() {
     Destroy();
 }
 
-bool GLEnv::Init(void* window) {
-    m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+bool GLEnv::CreateContext(EGLint surfaceType, EGLConfig& config) {
+    if (m_display == EGL_NO_DISPLAY)
+        m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
     if (m_display == EGL_NO_DISPLAY) return false;
 
     if (!eglInitialize(m_display, nullptr, nullptr)) return false;
 
     const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, surfaceType,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
         EGL_RED_SIZE, 8,
         EGL_GREEN_SIZE, 8,
         EGL_BLUE_SIZE, 8,
@@ -38,9 +45,8 @@ bool GLEnv::Init(void* window) {
         EGL_NONE
     };
 
-    EGLConfig config;
     EGLint numConfigs;
-    if (!eglChooseConfig(m_display, configAttribs, &config, 1, &numConfigs)) return false;
+    if (!eglChooseConfig(m_display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) return false;
 
     const EGLint contextAttribs[] = {
         EGL_CONTEXT_MAJOR_VERSION, 3,
@@ -49,7 +55,12 @@ bool GLEnv::Init(void* window) {
     };
 
     m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttribs);
-    if (m_context == EGL_NO_CONTEXT) return false;
+    return m_context != EGL_NO_CONTEXT;
+}
+
+bool GLEnv::Init(void* window) {
+    EGLConfig config;
+    if (!CreateContext(EGL_WINDOW_BIT, config)) return false;
 
     #ifdef __ANDROID__
         m_surface = eglCreateWindowSurface(m_display, config, (ANativeWindow*)window, nullptr);
@@ -67,6 +78,48 @@ bool GLEnv::Init(void* window) {
     return true;
 }
 
+bool GLEnv::InitOffscreen(int width, int height) {
+    EGLConfig config;
+    if (!CreateContext(EGL_PBUFFER_BIT, config)) return false;
+
+    const EGLint surfaceAttribs[] = {
+        EGL_WIDTH, width,
+        EGL_HEIGHT, height,
+        EGL_NONE
+    };
+    m_surface = eglCreatePbufferSurface(m_display, config, surfaceAttribs);
+    if (m_surface == EGL_NO_SURFACE) return false;
+
+    return eglMakeCurrent(m_display, m_surface, m_surface, m_context);
+}
+
+bool GLEnv::InitHeadless() {
+    #ifndef __ANDROID__
+        // Mesa can do without X11 or Wayland, so this works on a CI machine with no display
+        auto clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless") && getPlatformDisplay)
+            m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    #endif
+
+    EGLConfig config;
+    if (!CreateContext(EGL_PBUFFER_BIT, config)) return false;
+
+    auto extensions = eglQueryString(m_display, EGL_EXTENSIONS);
+    if (extensions && strstr(extensions, "EGL_KHR_surfaceless_context"))
+        return eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context);
+
+    const EGLint surfaceAttribs[] = {
+        EGL_WIDTH, 1,
+        EGL_HEIGHT, 1,
+        EGL_NONE
+    };
+    m_surface = eglCreatePbufferSurface(m_display, config, surfaceAttribs);
+    if (m_surface == EGL_NO_SURFACE) return false;
+
+    return eglMakeCurrent(m_display, m_surface, m_surface, m_context);
+}
+
 void GLEnv::Swap() {
     eglSwapBuffers(m_display, m_surface);
 }
@@ -85,9 +138,14 @@ void GLEnv::Destroy() {
 
 // ================= RenderDoku =================
 
-RenderDoku::RenderDoku() : m_program(0), m_vbo(0) {}
+RenderDoku::RenderDoku() : m_vbo(0) {}
 RenderDoku::~RenderDoku() {
-    if (m_program) glDeleteProgram(m_program);
+    for (auto& program : m_programs)
+        if (program.second.program) glDeleteProgram(program.second.program);
+    if (m_occupancyTexture) glDeleteTextures(1, &m_occupancyTexture);
+    if (m_tileQueue) glDeleteBuffers(1, &m_tileQueue);
+    if (m_tileData) glDeleteBuffers(1, &m_tileData);
+    if (m_historyTextures[0]) glDeleteTextures(2, m_historyTextures);
     if (m_vbo) glDeleteBuffers(1, &m_vbo);
     if (m_fbo) glDeleteFramebuffers(1, &m_fbo);
     if (m_fboTexture) glDeleteTextures(1, &m_fboTexture);
@@ -111,13 +169,12 @@ const char* FRAG_SHADER_PREFIX = R"(#version 310 es
 #define PI 3.14159265358979324
 #define M_L 0.3819660113
 #define M_R 0.6180339887
-#define MAXR 8
-#define SOLVER 8
-precision highp float;
-out highp vec4 fragColor;
+precision PRECISION float;
+layout(location = 0) out highp vec4 fragColor;
 // Forward declaration of kernal
 float kernal(vec3 ver);
-uniform vec3 right, forward, up, origin;
+// highp like in the vertex shader, whatever the default precision here
+uniform highp vec3 right, forward, up, origin;
 in vec3 dir, localdir;
 uniform float len;
 // Global variables for main loop to avoid stack overflow issues in some compilers (not strictly needed for GLSL ES but keeping close to source)
@@ -125,12 +182,26 @@ uniform float len;
 
 )";
 
+// With COUNT_EVALS defined every fractal evaluation is counted and main() outputs the
+// count instead of the color, 16 bits spread over red and green.
+const char* EVAL_COUNTER_SOURCE = R"(
+#ifdef COUNT_EVALS
+int evals = 0;
+#define COUNT_EVAL() evals++
+#define OUTPUT_EVALS() fragColor = vec4(float(evals / 256) / 255.0, float(evals % 256) / 255.0, 0.0, 1.0)
+#else
+#define COUNT_EVAL()
+#define OUTPUT_EVALS()
+#endif
+)";
+
 const char* KERNEL_SOURCE = R"(
 float kernal(vec3 ver){
+   COUNT_EVAL();
    vec3 a;
    float b,c,d,e;
    a=ver;
-   for(int i=0;i<5;i++){
+   for(int i=0;i<ITERATIONS;i++){
        b=length(a);
        c=atan(a.y,a.x)*8.0;
        e=1.0/b;
@@ -145,6 +216,144 @@ float kernal(vec3 ver){
 }
 )";
 
+// Limits of the march: the ray interval inside the bounding sphere and, with SKIP_GRID,
+// the empty cells of the occupancy grid. Every sample skipped this way is one kernal()
+// can only be negative at, so the image doesn't change.
+const char* SKIP_SOURCE = R"(
+#if defined(SKIP_SPHERE) || defined(SKIP_GRID)
+#define SKIP_BOUND
+// [near, far] of the ray inside the bounding sphere in units of dir; near > far on a miss
+vec2 boundingInterval() {
+   float a = dot(dir, dir);
+   float b = dot(origin, dir);
+   float c = dot(origin, origin) - BOUND_RADIUS*BOUND_RADIUS;
+   float h = b*b - a*c;
+   if (h < 0.0) {
+      return vec2(1.0, 0.0);
+   }
+   h = sqrt(h);
+   return vec2((-b - h) / a, (-b + h) / a);
+}
+#endif
+
+#ifdef SKIP_GRID
+uniform mediump sampler3D occupancy;
+// Where the ray leaves the grid cell around ver, in units of dir, if that cell holds no
+// surface; -1 otherwise
+float emptyCellExit(vec3 ver) {
+   float cellSize = 2.0*BOUND_RADIUS / float(GRID_SIZE);
+   ivec3 cell = ivec3(floor((ver + BOUND_RADIUS) / cellSize));
+   if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, ivec3(GRID_SIZE)))) {
+      return -1.0;
+   }
+   if (texelFetch(occupancy, cell, 0).r > 0.0) {
+      return -1.0;
+   }
+   vec3 d = mix(dir, vec3(1e-6), lessThan(abs(dir), vec3(1e-6)));
+   vec3 exitPlane = vec3(cell) * cellSize - BOUND_RADIUS + vec3(greaterThan(d, vec3(0.0))) * cellSize;
+   vec3 t = (exitPlane - origin) / d;
+   return min(min(t.x, t.y), t.z);
+}
+#endif
+)";
+
+// Reprojection of the previous frame's hits. Each pass writes where its ray hit, in units
+// of dir, and reads the previous pass's to start marching just before that.
+const char* REPROJECT_SOURCE = R"(
+#ifdef REPROJECT
+layout(location = 1) out highp uint hitDepth;
+#define OUTPUT_HIT(t) hitDepth = floatBitsToUint(t)
+uniform highp usampler2D history;
+uniform bool historyValid;
+uniform ivec2 historySize;
+uniform vec3 prevRight, prevForward, prevUp, prevOrigin;
+uniform highp float x, y;
+
+float historyDepth(ivec2 pixel) {
+   return uintBitsToFloat(texelFetch(history, clamp(pixel, ivec2(0), historySize - 1), 0).r);
+}
+
+// Where this ray likely hits, from the hit of the previous frame that is now closest
+// to it; 0 where there is nothing to go by: no history, a miss or a disocclusion
+float reprojectedStart() {
+   if (!historyValid) {
+      return 0.0;
+   }
+   // guess the depth from the same pixel, then look where that point was seen last frame
+   float t = historyDepth(ivec2(gl_FragCoord.xy));
+   if (t <= 0.0) {
+      return 0.0;
+   }
+   vec3 rel = origin + dir * t - prevOrigin;
+   float z = dot(rel, prevForward);
+   if (z <= 0.0) {
+      return 0.0;
+   }
+   vec2 ndc = vec2(dot(rel, prevRight) / (z * x), dot(rel, prevUp) / (z * y));
+   ivec2 center = ivec2(floor((ndc * 0.5 + 0.5) * vec2(historySize)));
+   if (any(lessThan(center, ivec2(0))) || any(greaterThanEqual(center, historySize))) {
+      return 0.0;
+   }
+
+   // nearest hit around there, so a surface that moved toward this ray isn't stepped over
+   float nearest = -1.0;
+   ivec2 nearestPixel = center;
+   for (int j = -1; j <= 1; j++) {
+      for (int i = -1; i <= 1; i++) {
+         float d = historyDepth(center + ivec2(i, j));
+         if (d > 0.0 && (nearest < 0.0 || d < nearest)) {
+            nearest = d;
+            nearestPixel = center + ivec2(i, j);
+         }
+      }
+   }
+   if (nearest < 0.0) {
+      return 0.0;
+   }
+
+   vec2 prevNdc = (vec2(nearestPixel) + 0.5) / vec2(historySize) * 2.0 - 1.0;
+   vec3 hit = prevOrigin + (prevForward + prevRight * prevNdc.x * x + prevUp * prevNdc.y * y) * nearest;
+   float along = dot(hit - origin, dir) / dot(dir, dir);
+   // farther than a few pixels from this ray it is some other surface
+   float pixel = along * length(dir) * 2.0 / float(historySize.x);
+   if (along <= 0.0 || length(origin + dir * along - hit) > 4.0 * pixel) {
+      return 0.0;
+   }
+   return along;
+}
+#else
+#define OUTPUT_HIT(t)
+#endif
+)";
+
+// Color of the surface hit at distance r3 along dir, shared by every shading mode.
+const char* SHADE_SOURCE = R"(
+vec3 shade(float r3) {
+   float r4;
+   vec3 ver = origin + dir*r3 ;
+    float r1_sq=ver.x*ver.x+ver.y*ver.y+ver.z*ver.z;
+   vec3 n;
+   n.x = kernal(ver - right * (r3*0.00025)) - kernal(ver + right * (r3*0.00025));
+   n.y = kernal(ver - up * (r3*0.00025)) - kernal(ver + up * (r3*0.00025));
+   n.z = kernal(ver + forward * (r3*0.00025)) - kernal(ver - forward * (r3*0.00025));
+   r3 = n.x*n.x+n.y*n.y+n.z*n.z;
+   n = n * (1.0 / sqrt(r3));
+   ver = localdir;
+   r3 = ver.x*ver.x+ver.y*ver.y+ver.z*ver.z;
+   ver = ver * (1.0 / sqrt(r3));
+   vec3 reflect = n * (-2.0*dot(ver, n)) + ver;
+   r3 = reflect.x*0.276+reflect.y*0.920+reflect.z*0.276;
+   r4 = n.x*0.276+n.y*0.920+n.z*0.276;
+   r3 = max(0.0,r3);
+   r3 = r3 * r3*r3*r3;
+   r3 = r3 * 0.45 + r4 * 0.25 + 0.3;
+   n.x = sin(r1_sq*10.0)*0.5+0.5;
+   n.y = sin(r1_sq*10.0+2.05)*0.5+0.5;
+   n.z = sin(r1_sq*10.0-2.05)*0.5+0.5;
+   return n*r3;
+}
+)";
+
 const char* FRAG_SHADER_MAIN = R"(
 void main() {
    vec3 color;
@@ -152,16 +361,60 @@ void main() {
    color.g=0.0;
    color.b=0.0;
    int sign=0;
-   const float step = 0.002;
+   const float step = STEP;
    
-   float v1 = kernal(origin + dir * (step*len));
-   float v2 = kernal(origin);
-   float v;
+   // samples k-2..k decide at step k, so the steps start and end two past the bounds
+   int kStart = 2;
+   int kEnd = STEPS + 2;
+#ifdef SKIP_BOUND
+   vec2 bound = boundingInterval();
+   if (bound.x > bound.y || bound.y < 0.0) {
+      kEnd = kStart;
+   }
+   else {
+      kStart = max(2, int(floor(bound.x / (step*len))));
+      kEnd = min(STEPS + 2, int(ceil(bound.y / (step*len))) + 3);
+   }
+#endif
+#ifdef MARCH_FROM
+   // the compute backend's tile pass found no surface before this
+   kStart = max(kStart, int(floor(MARCH_FROM / (step*len))));
+#endif
+   float v1, v2, v;
+   bool started = false;
+#ifdef REPROJECT
+   // a few steps before the reprojected hit, unless that is inside the surface already
+   int kReprojected = int(floor(reprojectedStart() / (step*len))) - 4;
+   if (kReprojected > kStart && kReprojected < kEnd) {
+      v1 = kernal(origin + dir * (step*len*float(kReprojected - 1)));
+      v2 = kernal(origin + dir * (step*len*float(kReprojected - 2)));
+      started = v1 < 0.0 && v2 < 0.0;
+      if (started) {
+         kStart = kReprojected;
+      }
+   }
+#endif
+   if (!started && kStart < kEnd) {
+      v1 = kernal(origin + dir * (step*len*float(kStart - 1)));
+      v2 = kernal(origin + dir * (step*len*float(kStart - 2)));
+   }
    
    float r1, r2, r3, r4, m1, m2, m3;
    
-   for (int k = 2; k < 1002; k++) {
+   for (int k = kStart; k < kEnd; k++) {
       vec3 ver = origin + dir * (step*len*float(k));
+#ifdef SKIP_GRID
+      // the grid is dilated by a cell, far more than the two steps looked back at, so
+      // no step up to the cell exit can see the surface; resume there with fresh history
+      float tEmpty = emptyCellExit(ver);
+      int next = int(floor(tEmpty / (step*len))) + 1;
+      if (tEmpty >= 0.0 && next > k + 2) {
+         k = next - 1;
+         v1 = kernal(origin + dir * (step*len*float(k)));
+         v2 = kernal(origin + dir * (step*len*float(k - 1)));
+         continue;
+      }
+#endif
       v = kernal(ver);
       if (v > 0.0 && v1 < 0.0) {
          r1 = step * len*float(k - 1);
@@ -257,29 +510,229 @@ void main() {
       v1 = v;
    }
    if (sign==1) {
-      vec3 ver = origin + dir*r3 ;
-       float r1_sq=ver.x*ver.x+ver.y*ver.y+ver.z*ver.z;
-      vec3 n;
-      n.x = kernal(ver - right * (r3*0.00025)) - kernal(ver + right * (r3*0.00025));
-      n.y = kernal(ver - up * (r3*0.00025)) - kernal(ver + up * (r3*0.00025));
-      n.z = kernal(ver + forward * (r3*0.00025)) - kernal(ver - forward * (r3*0.00025));
-      r3 = n.x*n.x+n.y*n.y+n.z*n.z;
-      n = n * (1.0 / sqrt(r3));
-      ver = localdir;
-      r3 = ver.x*ver.x+ver.y*ver.y+ver.z*ver.z;
-      ver = ver * (1.0 / sqrt(r3));
-      vec3 reflect = n * (-2.0*dot(ver, n)) + ver;
-      r3 = reflect.x*0.276+reflect.y*0.920+reflect.z*0.276;
-      r4 = n.x*0.276+n.y*0.920+n.z*0.276;
-      r3 = max(0.0,r3);
-      r3 = r3 * r3*r3*r3;
-      r3 = r3 * 0.45 + r4 * 0.25 + 0.3;
-      n.x = sin(r1_sq*10.0)*0.5+0.5;
-      n.y = sin(r1_sq*10.0+2.05)*0.5+0.5;
-      n.z = sin(r1_sq*10.0-2.05)*0.5+0.5;
-      color = n*r3;
+      color = shade(r3);
    }
    fragColor = vec4(color.x, color.y, color.z, 1.0);
+   OUTPUT_HIT(sign==1 ? r3 : -1.0);
+   OUTPUT_EVALS();
+}
+)";
+
+// Distance estimate for sphere tracing: the kernal() iteration, also carrying the
+// running derivative dr = |da/dver|, which the power-8 step scales by 8*r^7.
+// kernal() is zero where the final |a| is 2, so 0.5*log(r/2)*r/dr is a conservative
+// distance to that surface; it is negative inside.
+const char* DE_SOURCE = R"(
+float de(vec3 ver){
+   COUNT_EVAL();
+   vec3 a=ver;
+   float r=length(a);
+   float dr=1.0;
+   float b,c,d;
+   for(int i=0;i<ITERATIONS;i++){
+       r=length(a);
+       c=atan(a.y,a.x)*8.0;
+       d=acos(a.z/r)*8.0;
+       dr=8.0*pow(r,7.0)*dr+1.0;
+       b=pow(r,8.0);
+       a=vec3(b*sin(d)*cos(c),b*sin(d)*sin(c),b*cos(d))+ver;
+       if(b>6.0){
+           break;
+       }
+   }
+   r=length(a);
+   return 0.5*log(r/2.0)*r/dr;
+}
+)";
+
+const char* FRAG_SHADER_SPHERE_MAIN = R"(
+void main() {
+   vec3 color = vec3(0.0);
+   // t is in units of dir like r3 of the fixed-step mode, which only accepts hits in
+   // (step*len, 2*len); dir isn't normalized, so distances are divided by its length
+   float dirLen = length(dir);
+   float t = STEP * len;
+   float tmax = 2.0 * len;
+#ifdef SKIP_BOUND
+   vec2 bound = boundingInterval();
+   t = max(t, bound.x);
+   tmax = min(tmax, bound.y);
+#endif
+#ifdef MARCH_FROM
+   t = max(t, MARCH_FROM);
+#endif
+#ifdef REPROJECT
+   // the same margin as the fixed-step mode, unless that is inside the surface already
+   float tReprojected = reprojectedStart() - 4.0 * STEP * len;
+   if (tReprojected > t && tReprojected < tmax && de(origin + dir * tReprojected) > 0.0) {
+      t = tReprojected;
+   }
+#endif
+   int sign = 0;
+   for (int k = 0; k < MAX_STEPS && t < tmax; k++) {
+#ifdef SKIP_GRID
+      float tEmpty = emptyCellExit(origin + dir * t);
+      if (tEmpty >= 0.0) {
+         // just past the exit, so the next lookup is in the next cell
+         t = max(t, tEmpty) + 0.0001 * len;
+         continue;
+      }
+#endif
+      float d = de(origin + dir * t);
+      if (d < 0.0005 * t * dirLen) {
+         sign = 1;
+         break;
+      }
+      t += d / dirLen;
+   }
+   if (sign==1) {
+      color = shade(t);
+   }
+   fragColor = vec4(color, 1.0);
+   OUTPUT_HIT(sign==1 ? t : -1.0);
+   OUTPUT_EVALS();
+}
+)";
+
+// Compute backend. A tile pass marches every ray of an 8x8 tile coarsely, keeps the nearest
+// stop in shared memory and queues the tiles where something was found. Persistent groups
+// of the march pass then take pixels of queued tiles from an atomic counter until none are
+// left, running the fragment path's main() from the tile's nearest stop, so the threads
+// of tiles with nothing in them go to other tiles instead of idling.
+// The two passes are separate because ES 3.1 allows barrier() only outside control flow,
+// which rules out a work loop that shares per-tile results through shared memory.
+const char* COMPUTE_SHADER_PREFIX = R"(#version 310 es
+#define PI 3.14159265358979324
+#define M_L 0.3819660113
+#define M_R 0.6180339887
+precision PRECISION float;
+layout(local_size_x = 8, local_size_y = 8) in;
+// per invocation what the fragment path gets from the vertex shader and writes out
+vec3 dir, localdir;
+vec4 fragColor;
+float marchFrom;
+float kernal(vec3 ver);
+uniform vec3 right, forward, up, origin;
+uniform float len, x, y;
+uniform ivec2 targetSize;
+layout(rgba8, binding = 0) writeonly uniform highp image2D target;
+layout(std430, binding = 0) buffer Queue {
+   uint next;
+   uint count;
+   uint tiles[];
+};
+// per tile: bits of the float to march from, evaluations of the tile pass
+layout(std430, binding = 1) buffer TileData {
+   uvec2 tileData[];
+};
+
+// the ray the vertex shader would interpolate to this pixel's center
+void setRay(ivec2 pixel) {
+   vec2 position = (vec2(pixel) + 0.5) / vec2(targetSize) * 2.0 - 1.0;
+   dir = forward + right * position.x*x + up * position.y*y;
+   localdir = vec3(position.x*x, position.y*y, -1.0);
+}
+)";
+
+const char* COMPUTE_TILE_MAIN = R"(
+shared uint nearestBits;
+shared uint tileEvals;
+
+// Sphere tracing with a loose threshold, stopping before any surface the fine march can hit
+float coarseStop() {
+   float dirLen = length(dir);
+   float t = STEP * len;
+   float tmax = 2.0 * len;
+#ifdef SKIP_BOUND
+   vec2 bound = boundingInterval();
+   t = max(t, bound.x);
+   tmax = min(tmax, bound.y);
+#endif
+   for (int k = 0; k < 64 && t < tmax; k++) {
+#ifdef SKIP_GRID
+      float tEmpty = emptyCellExit(origin + dir * t);
+      if (tEmpty >= 0.0) {
+         t = max(t, tEmpty) + 0.0001 * len;
+         continue;
+      }
+#endif
+      float d = de(origin + dir * t);
+      if (d < 0.02 * t * dirLen) {
+         return t;
+      }
+      t += d / dirLen;
+   }
+   // out of steps counts as a stop, only leaving the bounds is a miss
+   return t < tmax ? t : -1.0;
+}
+
+void main() {
+   ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+   bool inside = all(lessThan(pixel, targetSize));
+   if (gl_LocalInvocationIndex == 0u) {
+      nearestBits = floatBitsToUint(1e30);
+      tileEvals = 0u;
+   }
+   memoryBarrierShared();
+   barrier();
+
+   if (inside) {
+      setRay(pixel);
+      float t = coarseStop();
+      // non-negative floats order like their bits
+      if (t >= 0.0) {
+         atomicMin(nearestBits, floatBitsToUint(t));
+      }
+#ifdef COUNT_EVALS
+      atomicAdd(tileEvals, uint(evals));
+#endif
+   }
+   memoryBarrierShared();
+   barrier();
+
+   bool empty = nearestBits == floatBitsToUint(1e30);
+   if (gl_LocalInvocationIndex == 0u) {
+      uint tile = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+      // back off like the reprojected start
+      tileData[tile] = uvec2(floatBitsToUint(uintBitsToFloat(nearestBits) - 4.0 * STEP * len), tileEvals);
+      if (!empty) {
+         tiles[atomicAdd(count, 1u)] = tile;
+      }
+   }
+   // the march pass never sees an empty tile, so it is finished here
+   if (empty && inside) {
+      fragColor = vec4(0.0, 0.0, 0.0, 1.0);
+#ifdef COUNT_EVALS
+      evals = int(tileEvals / 64u);
+      OUTPUT_EVALS();
+#endif
+      imageStore(target, pixel, fragColor);
+   }
+}
+)";
+
+const char* COMPUTE_MARCH_MAIN = R"(
+void main() {
+   uint tilesPerRow = uint(targetSize.x + 7) / 8u;
+   for (;;) {
+      uint i = atomicAdd(next, 1u);
+      if (i >= count * 64u) {
+         break;
+      }
+      uint tile = tiles[i / 64u];
+      ivec2 pixel = ivec2(tile % tilesPerRow, tile / tilesPerRow) * 8 + ivec2(i % 8u, (i / 8u) % 8u);
+      if (any(greaterThanEqual(pixel, targetSize))) {
+         continue;
+      }
+      setRay(pixel);
+      marchFrom = uintBitsToFloat(tileData[tile].x);
+#ifdef COUNT_EVALS
+      // the tile pass's share
+      evals = int(tileData[tile].y / 64u);
+#endif
+      marchPixel();
+      imageStore(target, pixel, fragColor);
+   }
 }
 )";
 
@@ -313,8 +766,30 @@ GLuint RenderDoku::CreateProgram(const char* vertexSource, const char* fragmentS
     GLuint program = glCreateProgram();
     glAttachShader(program, vertexShader);
     glAttachShader(program, fragmentShader);
+    // fixed so one vertex setup serves every program
+    glBindAttribLocation(program, m_aPosition, "position");
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    return CheckLinked(program);
+}
+
+GLuint RenderDoku::CreateComputeProgram(const char* computeSource) {
+    GLuint computeShader = CreateShader(GL_COMPUTE_SHADER, computeSource);
+    if (!computeShader) return 0;
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, computeShader);
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
+    glDeleteShader(computeShader);
 
+    return CheckLinked(program);
+}
+
+GLuint RenderDoku::CheckLinked(GLuint program) {
     GLint linked;
     glGetProgramiv(program, GL_LINK_STATUS, &linked);
     if (!linked) {
@@ -332,25 +807,244 @@ GLuint RenderDoku::CreateProgram(const char* vertexSource, const char* fragmentS
     return program;
 }
 
-void RenderDoku::Init() {
-    std::string fragSource = std::string(FRAG_SHADER_PREFIX) + KERNEL_SOURCE + FRAG_SHADER_MAIN;
-    m_program = CreateProgram(VERT_SHADER, fragSource.c_str());
+// kernal() of the shader, for baking the occupancy grid.
+static float Kernal(float x, float y, float z, int iterations) {
+    float ax = x, ay = y, az = z;
+    for (int i = 0; i < iterations; i++) {
+        float r = std::sqrt(ax * ax + ay * ay + az * az);
+        float c = std::atan2(ay, ax) * 8.0f;
+        float d = r > 0.0f ? std::acos(az / r) * 8.0f : 0.0f;
+        float b = std::pow(r, 8.0f);
+        ax = b * std::sin(d) * std::cos(c) + x;
+        ay = b * std::sin(d) * std::sin(c) + y;
+        az = b * std::cos(d) + z;
+        if (b > 6.0f) {
+            break;
+        }
+    }
+    return 4.0f - (ax * ax + ay * ay + az * az);
+}
 
-    if (!m_program) {
-        LOGE("Failed to create program");
+// GRID_SIZE^3 cells over the cube around the bounding sphere, x fastest, 255 where the
+// surface may be. A cell is marked if kernal() is positive at any of a lattice of points
+// on and inside it, then the marks are dilated by one cell to cover features thinner
+// than the lattice spacing. The fractal only depends on the iteration count, so each
+// count is baked once per process.
+const std::vector<unsigned char>& RenderDoku::BakeOccupancy(int iterations) {
+    static std::map<int, std::vector<unsigned char>> grids;
+    auto& grid = grids[iterations];
+    if (grid.empty()) grid = [=] {
+        constexpr int samples = 2;  // lattice spacing per cell
+        constexpr int points = GRID_SIZE * samples + 1;
+        constexpr float spacing = 2.0f * BOUND_RADIUS / (GRID_SIZE * samples);
+
+        std::vector<unsigned char> inside(points * points * points);
+        for (int z = 0; z < points; ++z) {
+            for (int y = 0; y < points; ++y) {
+                for (int x = 0; x < points; ++x) {
+                    float px = x * spacing - BOUND_RADIUS;
+                    float py = y * spacing - BOUND_RADIUS;
+                    float pz = z * spacing - BOUND_RADIUS;
+                    if (px * px + py * py + pz * pz > BOUND_RADIUS * BOUND_RADIUS)
+                        continue;
+                    inside[(z * points + y) * points + x] = Kernal(px, py, pz, iterations) > 0.0f;
+                }
+            }
+        }
+
+        std::vector<unsigned char> marked(GRID_SIZE * GRID_SIZE * GRID_SIZE);
+        for (int z = 0; z < GRID_SIZE; ++z) {
+            for (int y = 0; y < GRID_SIZE; ++y) {
+                for (int x = 0; x < GRID_SIZE; ++x) {
+                    bool any = false;
+                    for (int dz = 0; dz <= samples && !any; ++dz)
+                        for (int dy = 0; dy <= samples && !any; ++dy)
+                            for (int dx = 0; dx <= samples && !any; ++dx)
+                                any = inside[((z * samples + dz) * points + y * samples + dy) * points + x * samples + dx];
+                    marked[(z * GRID_SIZE + y) * GRID_SIZE + x] = any;
+                }
+            }
+        }
+
+        std::vector<unsigned char> dilated(marked.size());
+        for (int z = 0; z < GRID_SIZE; ++z) {
+            for (int y = 0; y < GRID_SIZE; ++y) {
+                for (int x = 0; x < GRID_SIZE; ++x) {
+                    bool any = false;
+                    for (int nz = std::max(z - 1, 0); nz <= std::min(z + 1, GRID_SIZE - 1); ++nz)
+                        for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, GRID_SIZE - 1); ++ny)
+                            for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, GRID_SIZE - 1); ++nx)
+                                any = any || marked[(nz * GRID_SIZE + ny) * GRID_SIZE + nx];
+                    dilated[(z * GRID_SIZE + y) * GRID_SIZE + x] = any ? 255 : 0;
+                }
+            }
+        }
+        return dilated;
+    }();
+    return grid;
+}
+
+void RenderDoku::UploadOccupancy() {
+    int iterations = DOKU_QUALITY[m_quality].iterations;
+    if (m_occupancyIterations == iterations)
         return;
+    glBindTexture(GL_TEXTURE_3D, m_occupancyTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, GRID_SIZE, GRID_SIZE, GRID_SIZE, GL_RED, GL_UNSIGNED_BYTE,
+                    BakeOccupancy(iterations).data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    m_occupancyIterations = iterations;
+}
+
+std::string RenderDoku::Defines(bool counting) const {
+    auto& quality = DOKU_QUALITY[m_quality];
+    std::string defines;
+    defines += "#define ITERATIONS " + std::to_string(quality.iterations) + "\n";
+    defines += "#define STEP " + std::to_string(quality.step) + "\n";
+    defines += "#define STEPS " + std::to_string(quality.steps) + "\n";
+    defines += "#define MAXR " + std::to_string(quality.refine) + "\n";
+    defines += "#define SOLVER " + std::to_string(quality.refine) + "\n";
+    defines += "#define MAX_STEPS " + std::to_string(quality.sphereSteps) + "\n";
+    defines += quality.highp ? "#define PRECISION highp\n" : "#define PRECISION mediump\n";
+    if (counting)
+        defines += "#define COUNT_EVALS\n";
+    if (m_skip != DokuSkip::None) {
+        defines += m_skip == DokuSkip::Grid ? "#define SKIP_GRID\n" : "#define SKIP_SPHERE\n";
+        defines += "#define BOUND_RADIUS " + std::to_string(BOUND_RADIUS) + "\n";
+        defines += "#define GRID_SIZE " + std::to_string(GRID_SIZE) + "\n";
+    }
+    if (m_shading == DokuShading::SphereTrace)
+        defines += "#define SPHERE_TRACE\n";
+    return defines;
+}
+
+// the main() of the fragment path for the current shading, with what it needs
+static std::string MarchSource(bool sphere) {
+    std::string source = EVAL_COUNTER_SOURCE;
+    source += KERNEL_SOURCE;
+    source += SKIP_SOURCE;
+    source += REPROJECT_SOURCE;
+    source += SHADE_SOURCE;
+    source += DE_SOURCE;
+    source += sphere ? FRAG_SHADER_SPHERE_MAIN : FRAG_SHADER_MAIN;
+    return source;
+}
+
+std::string RenderDoku::FragmentSource(bool counting) const {
+    std::string defines = Defines(counting);
+    if (m_reproject)
+        defines += "#define REPROJECT\n";
+
+    // #version has to stay the first line
+    std::string fragSource = FRAG_SHADER_PREFIX;
+    fragSource.insert(fragSource.find('\n') + 1, defines);
+    fragSource += MarchSource(m_shading == DokuShading::SphereTrace);
+    return fragSource;
+}
+
+GLuint RenderDoku::LoadOrCreateProgram(const char* vertexSource, const std::string& source) {
+    std::string sources = vertexSource ? vertexSource : "";
+    sources += '\0';
+    sources += source;
+
+    GLuint program = m_programCache.Load(sources);
+    if (program)
+        return program;
+    program = vertexSource ? CreateProgram(vertexSource, source.c_str()) : CreateComputeProgram(source.c_str());
+    if (program)
+        m_programCache.Store(sources, program);
+    return program;
+}
+
+const RenderDoku::Program& RenderDoku::GetProgram(bool counting) {
+    std::string fragSource = FragmentSource(counting);
+    // the #defines at the top tell the variants apart
+    auto& program = m_programs[fragSource.substr(0, fragSource.find("#define PI"))];
+    if (program.program)
+        return program;
+
+    program.program = LoadOrCreateProgram(VERT_SHADER, fragSource);
+    if (!program.program) {
+        LOGE("Failed to create program");
+        return program;
     }
+    GetUniforms(program);
+    return program;
+}
+
+const RenderDoku::Program& RenderDoku::GetComputeProgram(bool tilePass, bool counting) {
+    std::string defines = Defines(counting);
+    auto& program = m_programs[(tilePass ? "#tile\n" : "#march\n") + defines];
+    if (program.program)
+        return program;
+
+    std::string source = COMPUTE_SHADER_PREFIX;
+    source.insert(source.find('\n') + 1, defines);
+    if (tilePass) {
+        source += EVAL_COUNTER_SOURCE;
+        source += KERNEL_SOURCE;
+        source += SKIP_SOURCE;
+        source += DE_SOURCE;
+        source += COMPUTE_TILE_MAIN;
+    } else {
+        // the fragment main() becomes a function run once per pixel
+        source += "#define MARCH_FROM marchFrom\n#define main marchPixel\n";
+        source += MarchSource(m_shading == DokuShading::SphereTrace);
+        source += "#undef main\n";
+        source += COMPUTE_MARCH_MAIN;
+    }
+    program.program = LoadOrCreateProgram(nullptr, source);
+    if (!program.program) {
+        LOGE("Failed to create compute program");
+        return program;
+    }
+    GetUniforms(program);
+    return program;
+}
+
+void RenderDoku::GetUniforms(Program& program) {
+    program.uRight = glGetUniformLocation(program.program, "right");
+    program.uForward = glGetUniformLocation(program.program, "forward");
+    program.uUp = glGetUniformLocation(program.program, "up");
+    program.uOrigin = glGetUniformLocation(program.program, "origin");
+    program.uX = glGetUniformLocation(program.program, "x");
+    program.uY = glGetUniformLocation(program.program, "y");
+    program.uLen = glGetUniformLocation(program.program, "len");
+    program.uOccupancy = glGetUniformLocation(program.program, "occupancy");
+    program.uHistory = glGetUniformLocation(program.program, "history");
+    program.uHistoryValid = glGetUniformLocation(program.program, "historyValid");
+    program.uHistorySize = glGetUniformLocation(program.program, "historySize");
+    program.uPrevRight = glGetUniformLocation(program.program, "prevRight");
+    program.uPrevForward = glGetUniformLocation(program.program, "prevForward");
+    program.uPrevUp = glGetUniformLocation(program.program, "prevUp");
+    program.uPrevOrigin = glGetUniformLocation(program.program, "prevOrigin");
+    program.uTargetSize = glGetUniformLocation(program.program, "targetSize");
+}
+
+double RenderDoku::TimeProgramBuild(bool fromCache) {
+    std::string sources = VERT_SHADER;
+    sources += '\0';
+    sources += FragmentSource(false);
 
-    glUseProgram(m_program);
+    auto start = std::chrono::high_resolution_clock::now();
+    GLuint program = fromCache ? m_programCache.Load(sources, false) : CreateProgram(VERT_SHADER, FragmentSource(false).c_str());
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    if (!program)
+        return -1;
+    glDeleteProgram(program);
+    return ms;
+}
 
-    m_uRight = glGetUniformLocation(m_program, "right");
-    m_uForward = glGetUniformLocation(m_program, "forward");
-    m_uUp = glGetUniformLocation(m_program, "up");
-    m_uOrigin = glGetUniformLocation(m_program, "origin");
-    m_uX = glGetUniformLocation(m_program, "x");
-    m_uY = glGetUniformLocation(m_program, "y");
-    m_uLen = glGetUniformLocation(m_program, "len");
-    m_aPosition = glGetAttribLocation(m_program, "position");
+void RenderDoku::Init() {
+    auto start = std::chrono::high_resolution_clock::now();
+    int hits = m_programCache.Hits();
+    bool built = GetProgram(false).program != 0;
+    m_initFromCache = m_programCache.Hits() > hits;
+    m_initProgramMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    LOGI("Program ready in %.1f ms, %s", m_initProgramMs, m_initFromCache ? "binary from cache" : "compiled from source");
+    if (!built)
+        return;
 
     float positions[] = {
         -1.0f, -1.0f, 0.0f, 
@@ -376,9 +1070,19 @@ void RenderDoku::Init() {
     glGenFramebuffers(1, &m_fbo);
     glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
 
+    // Hit distance history, attached as the second color buffer when reprojecting
+    glGenTextures(2, m_historyTextures);
+    for (auto texture : m_historyTextures) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, FBO_SIZE, FBO_SIZE, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
     glGenTextures(1, &m_fboTexture);
     glBindTexture(GL_TEXTURE_2D, m_fboTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, FBO_SIZE, FBO_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    // immutable, so the compute backend can bind it as an image
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, FBO_SIZE, FBO_SIZE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -392,6 +1096,18 @@ void RenderDoku::Init() {
 
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFBO);
     glBindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFBO);
+
+    for (auto& timer : m_passTimers)
+        timer.Init();
+
+    // Occupancy grid, read with texelFetch only, filled for the current quality
+    glGenTextures(1, &m_occupancyTexture);
+    glBindTexture(GL_TEXTURE_3D, m_occupancyTexture);
+    glTexStorage3D(GL_TEXTURE_3D, 1, GL_R8, GRID_SIZE, GRID_SIZE, GRID_SIZE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    UploadOccupancy();
 }
 
 void RenderDoku::Resize(int width, int height) {
@@ -410,16 +1126,18 @@ void RenderDoku::Tick() {
     ang1 += 0.01f;
 }
 
-void RenderDoku::Render() {
-    GLint oldDrawFBO, oldReadFBO;
-    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldDrawFBO);
-    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldReadFBO);
+RenderDoku::Camera RenderDoku::GetCamera() const {
+    Camera camera = {
+        { len * std::cos(ang1) * std::cos(ang2) + cenx, len * std::sin(ang2) + ceny, len * std::sin(ang1) * std::cos(ang2) + cenz },
+        { std::sin(ang1), 0.0f, -std::cos(ang1) },
+        { -std::sin(ang2) * std::cos(ang1), std::cos(ang2), -std::sin(ang2) * std::sin(ang1) },
+        { -std::cos(ang1) * std::cos(ang2), -std::sin(ang2), -std::sin(ang1) * std::cos(ang2) },
+    };
+    return camera;
+}
 
-    // Render to FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-    glViewport(0, 0, FBO_SIZE, FBO_SIZE);
-    
-    glUseProgram(m_program);
+void RenderDoku::SetUniforms(const Program& program) {
+    glUseProgram(program.program);
 
     // Uniform setting logic from draw()
     // gl.uniform1f(glx, cx * 2.0 / (cx + cy)); -> In our case cx=cy, so 2*cx / 2*cx = 1.0
@@ -427,33 +1145,297 @@ void RenderDoku::Render() {
     float ratioX = 1.0f; // cx * 2.0 / (cx + cy); since cx==cy, this is 1.0.
     float ratioY = 1.0f; // cy * 2.0 / (cx + cy);
 
-    glUniform1f(m_uX, ratioX);
-    glUniform1f(m_uY, ratioY);
-    glUniform1f(m_uLen, len);
+    glUniform1f(program.uX, ratioX);
+    glUniform1f(program.uY, ratioY);
+    glUniform1f(program.uLen, len);
     
-    float ox = len * std::cos(ang1) * std::cos(ang2) + cenx;
-    float oy = len * std::sin(ang2) + ceny;
-    float oz = len * std::sin(ang1) * std::cos(ang2) + cenz;
-    glUniform3f(m_uOrigin, ox, oy, oz);
+    auto camera = GetCamera();
+    glUniform3fv(program.uOrigin, 1, camera.origin);
+    glUniform3fv(program.uRight, 1, camera.right);
+    glUniform3fv(program.uUp, 1, camera.up);
+    glUniform3fv(program.uForward, 1, camera.forward);
+
+    if (program.uOccupancy >= 0) {
+        UploadOccupancy();
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, m_occupancyTexture);
+        glUniform1i(program.uOccupancy, 1);
+        glActiveTexture(GL_TEXTURE0);
+    }
+}
+
+void RenderDoku::Draw(const Program& program) {
+    SetUniforms(program);
 
-    glUniform3f(m_uRight, std::sin(ang1), 0.0f, -std::cos(ang1));
-    glUniform3f(m_uUp, -std::sin(ang2) * std::cos(ang1), std::cos(ang2), -std::sin(ang2) * std::sin(ang1));
-    glUniform3f(m_uForward, -std::cos(ang1) * std::cos(ang2), -std::sin(ang2), -std::sin(ang1) * std::cos(ang2));
+    static const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    bool reproject = program.uHistory >= 0;
+    if (reproject) {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, m_historyTextures[m_historyIndex]);
+        glUniform1i(program.uHistory, 2);
+        glActiveTexture(GL_TEXTURE0);
+        // after a resize the stored pixels don't match this pass's
+        glUniform1i(program.uHistoryValid, m_historyValid && m_historySize == RenderSize());
+        glUniform2i(program.uHistorySize, RenderSize(), RenderSize());
+        glUniform3fv(program.uPrevOrigin, 1, m_historyCamera.origin);
+        glUniform3fv(program.uPrevRight, 1, m_historyCamera.right);
+        glUniform3fv(program.uPrevUp, 1, m_historyCamera.up);
+        glUniform3fv(program.uPrevForward, 1, m_historyCamera.forward);
+
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                               m_historyTextures[1 - m_historyIndex], 0);
+        glDrawBuffers(2, drawBuffers);
+    }
 
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
+    if (reproject)
+        glDrawBuffers(1, drawBuffers);
+}
+
+void RenderDoku::DrawCompute(bool counting) {
+    auto& tilePass = GetComputeProgram(true, counting);
+    auto& marchPass = GetComputeProgram(false, counting);
+    if (!tilePass.program || !marchPass.program) {
+        LOGE("Compute backend not available, using the fragment path");
+        m_backend = DokuBackend::Fragment;
+        return;
+    }
+
+    constexpr int maxTiles = (FBO_SIZE / TILE_SIZE) * (FBO_SIZE / TILE_SIZE);
+    if (!m_tileQueue) {
+        glGenBuffers(1, &m_tileQueue);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_tileQueue);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (2 + maxTiles) * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+        glGenBuffers(1, &m_tileData);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_tileData);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, maxTiles * 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    }
+    // next and count of the queue
+    const GLuint zero[2] = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_tileQueue);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_tileQueue);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_tileData);
+    glBindImageTexture(0, m_fboTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+    int size = RenderSize();
+    int tilesPerSide = (size + TILE_SIZE - 1) / TILE_SIZE;
+    SetUniforms(tilePass);
+    glUniform2i(tilePass.uTargetSize, size, size);
+    glDispatchCompute(tilesPerSide, tilesPerSide, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    SetUniforms(marchPass);
+    glUniform2i(marchPass.uTargetSize, size, size);
+    glDispatchCompute(std::min(tilesPerSide * tilesPerSide, MARCH_GROUPS), 1, 1);
+    // the blit and glReadPixels read the texture through the framebuffer; the next frame
+    // resets the queue the march pass updated with glBufferSubData
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT |
+                    GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void RenderDoku::RenderOffscreen() {
+    if (m_backend == DokuBackend::Compute) {
+        // no reprojection here, and what is in the history is getting stale
+        m_historyValid = false;
+        DrawCompute(false);
+        if (m_backend == DokuBackend::Compute)
+            return;
+    }
+
+    GLint oldDrawFBO;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldDrawFBO);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, RenderSize(), RenderSize());
+    auto& program = GetProgram(false);
+    Draw(program);
+    if (program.uHistory >= 0) {
+        m_historyIndex = 1 - m_historyIndex;
+        m_historyValid = true;
+        m_historySize = RenderSize();
+        m_historyCamera = GetCamera();
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFBO);
+}
+
+void RenderDoku::Render() {
+    GLint oldDrawFBO, oldReadFBO;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldDrawFBO);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldReadFBO);
+
+    // Render to FBO
+    auto& marchTimer = m_passTimers[(int)DokuPass::March];
+    marchTimer.Begin();
+    RenderOffscreen();
+    marchTimer.End();
+
+    // Results arrive a few frames late, the size they pick is used from the next frame
+    int size = RenderSize();
+    double gpuMs;
+    while (marchTimer.Poll(gpuMs)) {
+        AddPassTime(DokuPass::March, gpuMs);
+        if (m_dynamicResolution && !m_fixedRenderSize)
+            m_resolution.Update(gpuMs);
+    }
+
     // Blit to screen
+    auto& blitTimer = m_passTimers[(int)DokuPass::Blit];
+    blitTimer.Begin();
     glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFBO);
     
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    glBlitFramebuffer(0, 0, FBO_SIZE, FBO_SIZE,
+    // Bilinear upscale when rendered below full size
+    glBlitFramebuffer(0, 0, size, size,
                       m_offsetX, m_offsetY, m_offsetX + m_viewportSize, m_offsetY + m_viewportSize,
                       GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    blitTimer.End();
+    while (blitTimer.Poll(gpuMs))
+        AddPassTime(DokuPass::Blit, gpuMs);
                       
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFBO);
     glBindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFBO);
+
+    if (++m_logFrame % LOG_INTERVAL == 0)
+        LogPassTimes();
+}
+
+void RenderDoku::AddPassTime(DokuPass pass, double ms) {
+    m_passMs[(int)pass] = ms;
+    m_passSumMs[(int)pass] += ms;
+    ++m_passSamples[(int)pass];
+}
+
+void RenderDoku::LogPassTimes() {
+    auto average = [&](DokuPass pass) {
+        int n = m_passSamples[(int)pass];
+        return n ? m_passSumMs[(int)pass] / n : 0.0;
+    };
+    LOGI("GPU ms over %d frames: march %.2f, blit %.2f (%d / %d samples, %s), render size %d",
+         LOG_INTERVAL, average(DokuPass::March), average(DokuPass::Blit),
+         m_passSamples[(int)DokuPass::March], m_passSamples[(int)DokuPass::Blit],
+         m_passTimers[0].HasTimerQuery() ? "timer query" : "glFinish", RenderSize());
+    for (int i = 0; i < DOKU_PASS_COUNT; ++i) {
+        m_passSumMs[i] = 0;
+        m_passSamples[i] = 0;
+    }
+}
+
+std::vector<unsigned char> RenderDoku::ReadPixels() {
+    int size = RenderSize();
+    std::vector<unsigned char> pixels(size * size * 4);
+    GLint oldReadFBO;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldReadFBO);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFBO);
+    return pixels;
+}
+
+double RenderDoku::MeasureEvaluations() {
+    if (m_backend == DokuBackend::Compute) {
+        DrawCompute(true);
+        if (m_backend == DokuBackend::Compute)
+            return AverageEvaluations(ReadPixels());
+    }
+
+    auto& program = GetProgram(true);
+    if (!program.program)
+        return 0;
+
+    GLint oldDrawFBO;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldDrawFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, RenderSize(), RenderSize());
+    Draw(program);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFBO);
+
+    return AverageEvaluations(ReadPixels());
 }
 
+double RenderDoku::AverageEvaluations(const std::vector<unsigned char>& pixels) {
+    double total = 0;
+    for (size_t i = 0; i < pixels.size(); i += 4)
+        total += pixels[i] * 256 + pixels[i + 1];
+    return total / (pixels.size() / 4);
+}
+
+bool RenderDoku::SetOption(const std::string& option) {
+    auto eq = option.find('=');
+    if (eq == std::string::npos)
+        return false;
+    auto key = option.substr(0, eq);
+    auto value = option.substr(eq + 1);
+
+    if (key == "shading") {
+        if (value == "fixed")
+            SetShading(DokuShading::FixedStep);
+        else if (value == "sphere")
+            SetShading(DokuShading::SphereTrace);
+        else
+            return false;
+        return true;
+    }
+    if (key == "resolution") {
+        if (value == "dynamic")
+            SetDynamicResolution(true);
+        else if (value == "full")
+            SetDynamicResolution(false);
+        else
+            return false;
+        return true;
+    }
+    if (key == "target_ms") {
+        double ms = std::atof(value.c_str());
+        if (ms <= 0)
+            return false;
+        m_resolution.SetTarget(ms);
+        return true;
+    }
+    if (key == "quality") {
+        for (int i = 0; i < DOKU_QUALITY_COUNT; ++i) {
+            if (value == DOKU_QUALITY[i].name) {
+                SetQuality(i);
+                return true;
+            }
+        }
+        return false;
+    }
+    if (key == "backend") {
+        if (value == "fragment")
+            SetBackend(DokuBackend::Fragment);
+        else if (value == "compute")
+            SetBackend(DokuBackend::Compute);
+        else
+            return false;
+        return true;
+    }
+    if (key == "reproject") {
+        if (value == "on")
+            SetReprojection(true);
+        else if (value == "off")
+            SetReprojection(false);
+        else
+            return false;
+        return true;
+    }
+    if (key == "skip") {
+        if (value == "none")
+            SetSkip(DokuSkip::None);
+        else if (value == "sphere")
+            SetSkip(DokuSkip::Sphere);
+        else if (value == "grid")
+            SetSkip(DokuSkip::Grid);
+        else
+            return false;
+        return true;
+    }
+    return false;
+}
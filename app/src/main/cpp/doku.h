@@ -3,10 +3,15 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <GLES3/gl31.h>
+#include <GLES2/gl2ext.h>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <string>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
 
 class GLEnv {
 public:
@@ -14,43 +19,341 @@ public:
     ~GLEnv();
 
     bool Init(void* window); // Changed from ANativeWindow* to void* for cross-platform compatibility
+    // Context on a small pbuffer instead of a window, for compute and offscreen work.
+    bool InitOffscreen(int width = 1, int height = 1);
+    // Context without a default framebuffer to draw to: no surface at all with
+    // EGL_KHR_surfaceless_context, else a 1x1 pbuffer. Render into framebuffer objects.
+    // Off Android it prefers Mesa's surfaceless platform, which needs no display server.
+    bool InitHeadless();
     void Swap();
     void Destroy();
 
 private:
+    bool CreateContext(EGLint surfaceType, EGLConfig& config);
+
     EGLDisplay m_display;
     EGLContext m_context;
     EGLSurface m_surface;
 };
 
+// GPU time of one pass per frame. Uses GL_EXT_disjoint_timer_query where the driver has
+// it; otherwise times glFinish to glFinish on the CPU every few frames, stalling only those.
+class GpuTimer {
+public:
+    ~GpuTimer();
+
+    void Init();  // with the context current
+    void Begin();
+    void End();
+    // Oldest finished measurement; false if none is ready yet.
+    bool Poll(double& ms);
+    bool HasTimerQuery() const { return m_hasQuery; }
+
+private:
+    static constexpr int RING = 4;
+    static constexpr int FALLBACK_INTERVAL = 8;
+
+    bool m_hasQuery = false;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC m_getQueryObjectui64v = nullptr;
+    GLuint m_queries[RING] = {};
+    int m_head = 0;     // slot the next Begin uses
+    int m_pending = 0;  // queries ended and not read yet
+    bool m_active = false;
+    bool m_first = true;
+
+    int m_frame = 0;
+    std::chrono::high_resolution_clock::time_point m_start;
+    double m_fallbackMs = -1;
+};
+
+// Percentiles of a run of frame times, in ms
+struct FrameStats {
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+FrameStats GetFrameStats(std::vector<double> frameMs);
+
+// Chooses the render size for a GPU frame-time target, taking the cost as proportional
+// to the pixel count. The size only changes while the smoothed time stays outside a band
+// around the target, and after a change the measurements of older frames are dropped.
+class ResolutionController {
+public:
+    ResolutionController(int minSize, int maxSize) : m_minSize(minSize), m_maxSize(maxSize), m_size(maxSize) {}
+
+    void SetTarget(double ms) { m_targetMs = ms; m_samples = 0; }
+    double GetTarget() const { return m_targetMs; }
+    // Adds the GPU time of one frame; returns the size to render the next frames at.
+    int Update(double gpuMs);
+    int Size() const { return m_size; }
+    double SmoothedMs() const { return m_smoothedMs; }
+
+private:
+    static constexpr double SHRINK_ABOVE = 1.05;  // of the target
+    static constexpr double GROW_BELOW = 0.75;
+    static constexpr double AIM = 0.9;
+    static constexpr double MAX_GROWTH = 1.25;    // per change, in size
+    static constexpr int DISCARD_SAMPLES = 4;     // may still be frames of the old size
+    static constexpr int SETTLE_SAMPLES = 12;
+    static constexpr int ALIGN = 16;
+
+    int m_minSize;
+    int m_maxSize;
+    int m_size;
+    double m_targetMs = 16.6;
+    double m_smoothedMs = 0;
+    int m_samples = 0;
+};
+
+// GPU passes of RenderDoku::Render, timed separately
+enum class DokuPass {
+    March,  // RenderOffscreen: the ray march into the offscreen texture
+    Blit,   // clear and upscaling blit to the window
+};
+constexpr int DOKU_PASS_COUNT = 2;
+
+enum class DokuShading {
+    FixedStep,    // fixed-size steps of kernal(), then bisection / golden-section refinement
+    SphereTrace,  // steps by a distance estimate from the running derivative of the iteration
+};
+
+// Linked program binaries on disk, one file per program named by a hash of the GL renderer,
+// GL version and all sources. Drivers reject binaries of other driver builds; such a
+// file is deleted and the caller compiles from source as if it had never been cached.
+class ProgramCache {
+public:
+    // Caching stays off until a directory is set
+    void SetDirectory(const std::string& directory) { m_directory = directory; }
+    bool Enabled() const { return !m_directory.empty(); }
+
+    // The linked program, or 0 if there is no usable binary for these sources.
+    // `count` false leaves Hits() and Misses() alone.
+    GLuint Load(const std::string& sources, bool count = true);
+    void Store(const std::string& sources, GLuint program);
+
+    int Hits() const { return m_hits; }
+    int Misses() const { return m_misses; }
+
+private:
+    std::string Path(const std::string& sources) const;
+
+    std::string m_directory;
+    int m_hits = 0;
+    int m_misses = 0;
+};
+
+// One quality preset, turned into #defines of the shader variants
+struct DokuQuality {
+    const char* name;
+    int iterations;   // of the fractal; fewer make a blobbier shape
+    float step;       // of the fixed-step march, in units of len
+    int steps;        // of the fixed-step march
+    int refine;       // bisection and golden-section iterations
+    bool highp;       // float precision of the march, mediump otherwise
+    int sphereSteps;  // limit of the sphere-traced march
+};
+
+// "high" is what the renderer always drew before presets existed
+constexpr DokuQuality DOKU_QUALITY[] = {
+    { "low", 4, 0.004f, 500, 4, false, 96 },
+    { "medium", 5, 0.003f, 667, 6, true, 160 },
+    { "high", 5, 0.002f, 1000, 8, true, 256 },
+    { "ultra", 6, 0.001f, 2000, 10, true, 512 },
+};
+constexpr int DOKU_QUALITY_COUNT = sizeof(DOKU_QUALITY) / sizeof(DOKU_QUALITY[0]);
+constexpr int DOKU_QUALITY_DEFAULT = 2;
+
+enum class DokuBackend {
+    Fragment,  // a full-screen quad, every pixel on its own
+    Compute,   // GLES 3.1 compute in 8x8 tiles, see COMPUTE_SHADER_PREFIX
+};
+
+// What the march skips without sampling the fractal
+enum class DokuSkip {
+    None,
+    Sphere,  // outside the bounding sphere
+    Grid,    // also the empty cells of an occupancy grid inside it
+};
+
 class RenderDoku {
 public:
+    // Size of the offscreen texture the ray-march renders into
+    static constexpr int FBO_SIZE = 1024;
+
     RenderDoku();
     ~RenderDoku();
 
     void Init();
     void Resize(int width, int height);
+    int GetWindowWidth() const { return m_windowWidth; }
+    int GetWindowHeight() const { return m_windowHeight; }
     void Tick();
     void Render();
 
+    void SetShading(DokuShading shading) { m_shading = shading; }
+    DokuShading GetShading() const { return m_shading; }
+    // Index into DOKU_QUALITY; its variants are compiled when first drawn with
+    void SetQuality(int quality) { m_quality = quality; }
+    int GetQuality() const { return m_quality; }
+    void SetBackend(DokuBackend backend) { m_backend = backend; }
+    DokuBackend GetBackend() const { return m_backend; }
+    void SetSkip(DokuSkip skip) { m_skip = skip; }
+    DokuSkip GetSkip() const { return m_skip; }
+
+    // Dynamic resolution renders the offscreen pass at the size ResolutionController
+    // picks and upscales it bilinearly in the blit; otherwise always at FBO_SIZE.
+    void SetDynamicResolution(bool enabled) { m_dynamicResolution = enabled; }
+    bool GetDynamicResolution() const { return m_dynamicResolution; }
+    // Renders the offscreen pass at this size whatever dynamic resolution says, for
+    // repeatable measurements; clamped to FBO_SIZE, 0 goes back to the usual size.
+    void SetFixedRenderSize(int size) { m_fixedRenderSize = (std::max)(0, (std::min)(size, (int)FBO_SIZE)); }
+    int GetFixedRenderSize() const { return m_fixedRenderSize; }
+    // Side of the square the offscreen pass renders at, at most FBO_SIZE
+    int RenderSize() const {
+        if (m_fixedRenderSize)
+            return m_fixedRenderSize;
+        return m_dynamicResolution ? m_resolution.Size() : FBO_SIZE;
+    }
+    const ResolutionController& Resolution() const { return m_resolution; }
+    const GpuTimer& PassTimer(DokuPass pass) const { return m_passTimers[(int)pass]; }
+    // Latest GPU time of a pass in ms, 0 until its first measurement arrived. Frames
+    // are measured a few frames late, and under the fallback only every few frames.
+    double PassGpuMs(DokuPass pass) const { return m_passMs[(int)pass]; }
+
+    // Reprojection starts each ray's march a little before where the previous frame hit
+    // near it, marching all of it where that is missing or doesn't fit.
+    void SetReprojection(bool enabled) { m_reproject = enabled; m_historyValid = false; }
+    bool GetReprojection() const { return m_reproject; }
+
+    // Where program binaries are cached; set before Init for it to use the cache.
+    void SetCacheDirectory(const std::string& directory) { m_programCache.SetDirectory(directory); }
+    const ProgramCache& GetProgramCache() const { return m_programCache; }
+    // How long Init took to get its program, and whether it came from the cache
+    double InitProgramMs() const { return m_initProgramMs; }
+    bool InitFromCache() const { return m_initFromCache; }
+    // Builds the current fragment program once more, from source or from the cached
+    // binary, and deletes it again; ms, or -1 if that isn't possible.
+    double TimeProgramBuild(bool fromCache);
+
+    // Camera yaw, which Tick advances
+    float GetYaw() const { return ang1; }
+    void SetYaw(float yaw) { ang1 = yaw; }
+
+    // Applies a "key=value" option such as "shading=sphere"; false if it isn't known.
+    bool SetOption(const std::string& option);
+
+    // Ray-march pass only, into the offscreen texture.
+    void RenderOffscreen();
+    // RGBA8 contents of the offscreen texture, RenderSize() x RenderSize().
+    std::vector<unsigned char> ReadPixels();
+    // Average fractal evaluations per pixel of the current view and shading, measured
+    // with a variant of the shader that outputs its evaluation count.
+    double MeasureEvaluations();
+
 private:
+    friend class CpuRenderer;
+
+    struct Program {
+        GLuint program = 0;
+        GLint uRight = -1;
+        GLint uForward = -1;
+        GLint uUp = -1;
+        GLint uOrigin = -1;
+        GLint uX = -1;
+        GLint uY = -1;
+        GLint uLen = -1;
+        GLint uOccupancy = -1;
+        GLint uHistory = -1;
+        GLint uHistoryValid = -1;
+        GLint uHistorySize = -1;
+        GLint uPrevRight = -1;
+        GLint uPrevForward = -1;
+        GLint uPrevUp = -1;
+        GLint uPrevOrigin = -1;
+        GLint uTargetSize = -1;
+    };
+
+    struct Camera {
+        float origin[3];
+        float right[3];
+        float up[3];
+        float forward[3];
+    };
+    Camera GetCamera() const;
+
+    // kernal() is negative outside this radius: the first iteration already escapes
+    // there, since 6^(1/8) < 1.26
+    static constexpr float BOUND_RADIUS = 1.26f;
+    // Occupancy cells per axis of the cube around the bounding sphere
+    static constexpr int GRID_SIZE = 32;
+    static const std::vector<unsigned char>& BakeOccupancy(int iterations);
+    // Refills the occupancy texture if the quality's iteration count changed
+    void UploadOccupancy();
+
     GLuint CreateShader(GLenum type, const char* source);
     GLuint CreateProgram(const char* vertexSource, const char* fragmentSource);
-    
-    GLuint m_program;
+    GLuint CreateComputeProgram(const char* computeSource);
+    static GLuint CheckLinked(GLuint program);
+    static double AverageEvaluations(const std::vector<unsigned char>& pixels);
+    // #defines selecting the current quality, shading and skip
+    std::string Defines(bool counting) const;
+    std::string FragmentSource(bool counting) const;
+    // From the cache if possible; a compute program without vertexSource
+    GLuint LoadOrCreateProgram(const char* vertexSource, const std::string& source);
+    // Programs of the current quality, shading and skip, built on first use
+    const Program& GetProgram(bool counting);
+    const Program& GetComputeProgram(bool tilePass, bool counting);
+    void GetUniforms(Program& program);
+    void SetUniforms(const Program& program);
+    void Draw(const Program& program);
+    void AddPassTime(DokuPass pass, double ms);
+    void LogPassTimes();
+    // Falls back to the fragment backend if the compute programs can't be built
+    void DrawCompute(bool counting);
+
+    static constexpr int TILE_SIZE = 8;
+    // Groups of the persistent march pass, at most one per tile
+    static constexpr int MARCH_GROUPS = 256;
+
+    // by main() variant and #defines
+    std::map<std::string, Program> m_programs;
     GLuint m_vbo;
+    GLuint m_occupancyTexture = 0;
+    DokuShading m_shading = DokuShading::FixedStep;
+    int m_quality = DOKU_QUALITY_DEFAULT;
+    int m_occupancyIterations = 0;
+    DokuBackend m_backend = DokuBackend::Fragment;
+    GLuint m_tileQueue = 0;
+    ProgramCache m_programCache;
+    double m_initProgramMs = 0;
+    bool m_initFromCache = false;
+    GLuint m_tileData = 0;
+    DokuSkip m_skip = DokuSkip::Grid;
 
-    // Uniform locations
-    GLint m_uRight;
-    GLint m_uForward;
-    GLint m_uUp;
-    GLint m_uOrigin;
-    GLint m_uX;
-    GLint m_uY;
-    GLint m_uLen;
+    bool m_dynamicResolution = true;
+    int m_fixedRenderSize = 0;
+    ResolutionController m_resolution{ FBO_SIZE / 4, FBO_SIZE };
+    GpuTimer m_passTimers[DOKU_PASS_COUNT];
+    double m_passMs[DOKU_PASS_COUNT] = {};
+    // Averaged into a log line every LOG_INTERVAL frames
+    static constexpr int LOG_INTERVAL = 300;
+    double m_passSumMs[DOKU_PASS_COUNT] = {};
+    int m_passSamples[DOKU_PASS_COUNT] = {};
+    int m_logFrame = 0;
 
-    // Attribute locations
-    GLint m_aPosition;
+    // Hit distances along dir, as R32UI float bits, negative on a miss. The pass reads
+    // m_historyTextures[m_historyIndex] and writes the other one.
+    bool m_reproject = true;
+    GLuint m_historyTextures[2] = {};
+    int m_historyIndex = 0;
+    bool m_historyValid = false;
+    int m_historySize = 0;
+    Camera m_historyCamera = {};
+
+    // Attribute location, the same in every program
+    static constexpr GLuint m_aPosition = 0;
 
     // State variables from JS
     float cx, cy;
@@ -71,5 +374,57 @@ private:
     // Offscreen Rendering
     GLuint m_fbo = 0;
     GLuint m_fboTexture = 0;
-    const int FBO_SIZE = 1024;
 };
+
+class WorkStealingPool;
+
+// CPU port of the fixed-step fragment shader, for checking GPU output and for devices whose
+// GLES driver is broken. Neighbouring pixels march together in the SIMD lanes of the
+// build's instruction set, and a lane that finds a crossing refines it alone. Tiles are
+// spread over a work-stealing pool.
+class CpuRenderer {
+public:
+    explicit CpuRenderer(int threads = 0);  // 0: one per core
+    ~CpuRenderer();
+
+    // The view of doku at its quality, size x size RGBA8 with the bottom row first like
+    // RenderDoku::ReadPixels. Skipping and reprojection don't change the GPU image, so this
+    // is the image of every setting but DokuShading::SphereTrace. Needs no GL context.
+    std::vector<unsigned char> Render(const RenderDoku& doku, int size, bool simd = true);
+    int Threads() const;
+    // Lanes Render uses with simd: "AVX2", "SSE2", "NEON" or "scalar"
+    static const char* InstructionSet();
+
+private:
+    std::unique_ptr<WorkStealingPool> m_pool;
+};
+
+struct DokuBenchmarkConfig {
+    int frames = 300;
+    int width = RenderDoku::FBO_SIZE;
+    int height = RenderDoku::FBO_SIZE;
+    // Side the offscreen pass renders at; 0 for the target's shorter side. At most FBO_SIZE.
+    int renderSize = 0;
+    // Binary PPM of the last frame, if not empty
+    std::string dumpPath;
+};
+
+// Renders config.frames frames into a framebuffer object of width x height, after a few
+// warm-up frames, with glFinish after each. The camera starts at yaw 0 and turns by the
+// step of Tick, and the offscreen pass renders at a fixed size, so every run renders the
+// same images.
+// Only needs a current context: a window, a pbuffer or GLEnv::InitHeadless.
+// Returns frame-time statistics and the GPU time of each pass as a report.
+std::string RunDokuBenchmark(RenderDoku& doku, const DokuBenchmarkConfig& config);
+
+// Named measurement of the renderer, run on the thread its context is current on:
+//   "shading": frame time, evaluations per pixel and image difference of each DokuShading
+//   "skip": the same for each DokuSkip
+//   "backend": the same for each DokuBackend
+//   "quality": the same for each preset of DOKU_QUALITY, against "high"
+//   "reproject": the same over a few frames of camera motion, with and without reprojection
+//   "resolution": state of the dynamic-resolution controller
+//   "startup": program setup time of Init, and compiling against loading the cached binary
+//   "benchmark": RunDokuBenchmark with 120 frames at FBO_SIZE
+//   "cpu": CpuRenderer throughput, and its image against the GPU's where there is a context
+std::string RunDokuReport(RenderDoku& doku, const std::string& name);
@@ -0,0 +1,359 @@
+#include "doku.h"
+
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+// Reports run on the render thread, between frames, with the view as it is on screen.
+
+static constexpr int warmupFrames = 2;
+static constexpr int measuredFrames = 10;
+
+// Average ms of the ray-march pass alone, no Tick so every frame shows the same view.
+static double TimeOffscreen(RenderDoku& doku) {
+    using clock = std::chrono::high_resolution_clock;
+    for (int i = 0; i < warmupFrames; ++i)
+        doku.RenderOffscreen();
+    glFinish();
+
+    auto start = clock::now();
+    for (int i = 0; i < measuredFrames; ++i)
+        doku.RenderOffscreen();
+    glFinish();
+    return std::chrono::duration<double, std::milli>(clock::now() - start).count() / measuredFrames;
+}
+
+// Mean absolute difference of the RGB channels, 0-255.
+static double ImageDiff(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b) {
+    double total = 0;
+    size_t count = 0;
+    for (size_t i = 0; i + 3 < a.size() && i + 3 < b.size(); i += 4) {
+        for (int c = 0; c < 3; ++c)
+            total += std::abs(a[i + c] - b[i + c]);
+        count += 3;
+    }
+    return count ? total / count : 0;
+}
+
+struct Measurement {
+    double ms;
+    double evals;
+    std::vector<unsigned char> image;
+};
+
+static Measurement Measure(RenderDoku& doku) {
+    Measurement m;
+    m.ms = TimeOffscreen(doku);
+    m.image = doku.ReadPixels();
+    m.evals = doku.MeasureEvaluations();
+    return m;
+}
+
+template<class Mode>
+struct NamedMode {
+    Mode mode;
+    const char* name;
+};
+
+// Measures each mode set through `set`, diffing the images against the first mode's;
+// the setting from before is restored.
+template<class Mode, size_t N, class Get, class Set>
+static std::string CompareModes(RenderDoku& doku, const char* title, const NamedMode<Mode> (&modes)[N], Get get, Set set) {
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << title << "  ms/frame  evals/pixel  diff  " << doku.RenderSize() << "x" << doku.RenderSize() << "\n";
+
+    auto previous = (doku.*get)();
+    std::vector<unsigned char> reference;
+    for (auto& mode : modes) {
+        (doku.*set)(mode.mode);
+        auto m = Measure(doku);
+        // e.g. the compute backend falling back to fragment; its numbers aren't this mode's
+        if ((doku.*get)() != mode.mode) {
+            report << mode.name << "  not available, fell back\n";
+            continue;
+        }
+        if (reference.empty())
+            reference = m.image;
+        report << mode.name << "  " << m.ms << "  " << m.evals << "  " << ImageDiff(reference, m.image) << "\n";
+    }
+    (doku.*set)(previous);
+    return report.str();
+}
+
+static std::string ShadingReport(RenderDoku& doku) {
+    static constexpr NamedMode<DokuShading> modes[] = {
+        { DokuShading::FixedStep, "fixed" },
+        { DokuShading::SphereTrace, "sphere" },
+    };
+    return CompareModes(doku, "shading", modes, &RenderDoku::GetShading, &RenderDoku::SetShading);
+}
+
+// Each DokuSkip with the current shading, against not skipping at all.
+static std::string SkipReport(RenderDoku& doku) {
+    static constexpr NamedMode<DokuSkip> modes[] = {
+        { DokuSkip::None, "none" },
+        { DokuSkip::Sphere, "sphere" },
+        { DokuSkip::Grid, "grid" },
+    };
+    return CompareModes(doku, "skip", modes, &RenderDoku::GetSkip, &RenderDoku::SetSkip);
+}
+
+// Both backends with the current shading and skip.
+static std::string BackendReport(RenderDoku& doku) {
+    static constexpr NamedMode<DokuBackend> modes[] = {
+        { DokuBackend::Fragment, "fragment" },
+        { DokuBackend::Compute, "compute" },
+    };
+    return CompareModes(doku, "backend", modes, &RenderDoku::GetBackend, &RenderDoku::SetBackend);
+}
+
+// Presets with the current shading, skip and backend, against the default preset.
+static std::string QualityReport(RenderDoku& doku) {
+    static const NamedMode<int> modes[] = {
+        { DOKU_QUALITY_DEFAULT, DOKU_QUALITY[DOKU_QUALITY_DEFAULT].name },
+        { 0, DOKU_QUALITY[0].name },
+        { 1, DOKU_QUALITY[1].name },
+        { 3, DOKU_QUALITY[3].name },
+    };
+    return CompareModes(doku, "quality", modes, &RenderDoku::GetQuality, &RenderDoku::SetQuality);
+}
+
+// The same camera motion as on screen, with and without reprojection. Evaluations are
+// counted after each Tick, against the history of the frame before.
+static std::string ReprojectReport(RenderDoku& doku) {
+    static constexpr int frames = 8;
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "reproject  ms/frame  evals/pixel  " << frames << " frames  " << doku.RenderSize() << "x" << doku.RenderSize() << "\n";
+
+    auto previous = doku.GetReprojection();
+    float yaw = doku.GetYaw();
+    std::vector<unsigned char> images[2];
+    for (int on = 0; on < 2; ++on) {
+        using clock = std::chrono::high_resolution_clock;
+        doku.SetReprojection(on != 0);
+        doku.SetYaw(yaw);
+        // the first frame only fills the history
+        doku.RenderOffscreen();
+        glFinish();
+
+        double totalMs = 0, totalEvals = 0;
+        for (int i = 0; i < frames; ++i) {
+            doku.Tick();
+            totalEvals += doku.MeasureEvaluations();
+            auto start = clock::now();
+            doku.RenderOffscreen();
+            glFinish();
+            totalMs += std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        }
+        images[on] = doku.ReadPixels();
+        report << (on ? "on" : "off") << "  " << totalMs / frames << "  " << totalEvals / frames << "\n";
+    }
+    doku.SetReprojection(previous);
+    doku.SetYaw(yaw);
+
+    report << "mean abs diff of the last frame: " << ImageDiff(images[0], images[1]) << " / 255\n";
+    return report.str();
+}
+
+// Program setup of Init, and the current program built both ways right now.
+static std::string StartupReport(RenderDoku& doku) {
+    auto& cache = doku.GetProgramCache();
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "program cache: " << (cache.Enabled() ? "on" : "off") << ", " << cache.Hits() << " hits, "
+           << cache.Misses() << " misses\n";
+    report << "Init program: " << doku.InitProgramMs() << " ms, "
+           << (doku.InitFromCache() ? "binary from cache" : "compiled from source") << "\n";
+
+    double sourceMs = doku.TimeProgramBuild(false);
+    double binaryMs = doku.TimeProgramBuild(true);
+    report << "compile from source: " << sourceMs << " ms\n";
+    if (binaryMs < 0) {
+        report << "load binary: not cached\n";
+    } else {
+        report << "load binary: " << binaryMs << " ms\n";
+        report << "saved per start: " << sourceMs - binaryMs << " ms\n";
+    }
+    // drivers may keep their own cache of compiled shaders, making the first line fast too
+    return report.str();
+}
+
+// State of the dynamic-resolution controller as of the last frames on screen.
+static std::string ResolutionReport(RenderDoku& doku) {
+    auto& resolution = doku.Resolution();
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "dynamic resolution: " << (doku.GetDynamicResolution() ? "on" : "off") << "\n";
+    report << "render size: " << doku.RenderSize() << " of " << RenderDoku::FBO_SIZE << "\n";
+    report << "target: " << resolution.GetTarget() << " ms, smoothed GPU time: " << resolution.SmoothedMs() << " ms\n";
+    report << "last GPU time: march " << doku.PassGpuMs(DokuPass::March) << " ms, blit "
+           << doku.PassGpuMs(DokuPass::Blit) << " ms\n";
+    report << "timing: " << (doku.PassTimer(DokuPass::March).HasTimerQuery() ? "GL_EXT_disjoint_timer_query" : "glFinish every few frames") << "\n";
+    return report.str();
+}
+
+// CPU reference renderer: throughput of its scalar and SIMD lanes and, with a GL context,
+// how far the GPU's fixed-step image of the same view is from it.
+static std::string CpuReport(RenderDoku& doku) {
+    using clock = std::chrono::high_resolution_clock;
+    CpuRenderer cpu;
+    int size = doku.RenderSize();
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "CPU: " << CpuRenderer::InstructionSet() << ", " << cpu.Threads() << " threads, "
+           << size << "x" << size << ", quality " << DOKU_QUALITY[doku.GetQuality()].name << "\n";
+
+    std::vector<unsigned char> images[2];
+    for (int simd = 0; simd < 2; ++simd) {
+        auto start = clock::now();
+        images[simd] = cpu.Render(doku, size, simd != 0);
+        double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        report << (simd ? CpuRenderer::InstructionSet() : "scalar") << "  " << ms << " ms  "
+               << size * size / ms / 1000.0 << " Mpixels/s\n";
+    }
+    report << "diff SIMD / scalar: " << ImageDiff(images[0], images[1]) << "\n";
+
+    if (eglGetCurrentContext() == EGL_NO_CONTEXT)
+        return report.str();
+    auto previous = doku.GetShading();
+    doku.SetShading(DokuShading::FixedStep);
+    doku.RenderOffscreen();
+    auto gpu = doku.ReadPixels();
+    doku.SetShading(previous);
+
+    // a few pixels where float rounding tips a ray over the fractal's fine detail are expected
+    if (!DOKU_QUALITY[doku.GetQuality()].highp)
+        report << "the GPU runs this quality at mediump, the CPU at full float\n";
+    size_t differing = 0;
+    int maxDiff = 0;
+    for (size_t i = 0; i + 3 < gpu.size() && i + 3 < images[1].size(); i += 4) {
+        int pixelDiff = 0;
+        for (int c = 0; c < 3; ++c)
+            pixelDiff = std::max(pixelDiff, std::abs(gpu[i + c] - images[1][i + c]));
+        maxDiff = std::max(maxDiff, pixelDiff);
+        differing += pixelDiff > 16;
+    }
+    report << "diff GPU / CPU: mean " << ImageDiff(gpu, images[1]) << ", max " << maxDiff << ", "
+           << differing * 100.0 / (size * size) << "% of pixels off by more than 16\n";
+    return report.str();
+}
+
+// Bottom row first, as glReadPixels returns it
+static bool WritePPM(const std::string& path, int width, int height, const std::vector<unsigned char>& rgba) {
+    std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(path.c_str(), "wb"), fclose);
+    if (!file)
+        return false;
+    fprintf(file.get(), "P6\n%d %d\n255\n", width, height);
+    std::vector<unsigned char> row(width * 3);
+    for (int y = height - 1; y >= 0; --y) {
+        for (int x = 0; x < width; ++x)
+            std::copy_n(&rgba[(y * width + x) * 4], 3, &row[x * 3]);
+        if (fwrite(row.data(), row.size(), 1, file.get()) != 1)
+            return false;
+    }
+    return true;
+}
+
+std::string RunDokuBenchmark(RenderDoku& doku, const DokuBenchmarkConfig& config) {
+    using clock = std::chrono::high_resolution_clock;
+    static constexpr int benchmarkWarmup = 5;
+
+    GLint oldDrawFBO, oldReadFBO;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldDrawFBO);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldReadFBO);
+    int oldWidth = doku.GetWindowWidth(), oldHeight = doku.GetWindowHeight();
+    float oldYaw = doku.GetYaw();
+    int oldFixedSize = doku.GetFixedRenderSize();
+
+    // stands in for the window, Render blits to whatever draw framebuffer is bound
+    GLuint fbo, color;
+    glGenRenderbuffers(1, &color);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, config.width, config.height);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+
+    doku.Resize(config.width, config.height);
+    doku.SetFixedRenderSize(config.renderSize ? config.renderSize : (std::min)(config.width, config.height));
+    doku.SetYaw(0.0f);
+
+    std::vector<double> frameMs, marchMs, blitMs;
+    for (int i = 0; i < benchmarkWarmup + config.frames; ++i) {
+        auto start = clock::now();
+        doku.Render();
+        glFinish();
+        double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        if (i >= benchmarkWarmup) {
+            frameMs.push_back(ms);
+            // the pass times lag a frame or more behind, the averages still hold
+            marchMs.push_back(doku.PassGpuMs(DokuPass::March));
+            blitMs.push_back(doku.PassGpuMs(DokuPass::Blit));
+        }
+        doku.Tick();
+    }
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "GLES: " << (const char*)glGetString(GL_RENDERER) << "\n";
+    report << config.frames << " frames at " << config.width << "x" << config.height
+           << ", render size " << doku.RenderSize() << "x" << doku.RenderSize() << "\n";
+    auto frames = GetFrameStats(frameMs);
+    report << "frame_ms  mean  p50  p90  p99  max\n";
+    report << "frame  " << frames.mean << "  " << frames.p50 << "  " << frames.p90 << "  "
+           << frames.p99 << "  " << frames.max << "\n";
+    report << "fps: " << (frames.mean > 0 ? 1000.0 / frames.mean : 0) << "\n";
+    report << "GPU ms: march " << GetFrameStats(marchMs).mean << ", blit " << GetFrameStats(blitMs).mean
+           << " (" << (doku.PassTimer(DokuPass::March).HasTimerQuery() ? "timer query" : "glFinish") << ")\n";
+
+    if (!config.dumpPath.empty()) {
+        std::vector<unsigned char> pixels(config.width * config.height * 4);
+        glReadPixels(0, 0, config.width, config.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        bool written = WritePPM(config.dumpPath, config.width, config.height, pixels);
+        report << "last frame: " << (written ? "written to " : "could not write ") << config.dumpPath << "\n";
+    }
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR)
+        report << "GL error 0x" << std::hex << error << "\n";
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFBO);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFBO);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &color);
+    doku.Resize(oldWidth, oldHeight);
+    doku.SetFixedRenderSize(oldFixedSize);
+    doku.SetYaw(oldYaw);
+    return report.str();
+}
+
+std::string RunDokuReport(RenderDoku& doku, const std::string& name) {
+    if (name == "shading")
+        return ShadingReport(doku);
+    if (name == "skip")
+        return SkipReport(doku);
+    if (name == "backend")
+        return BackendReport(doku);
+    if (name == "quality")
+        return QualityReport(doku);
+    if (name == "reproject")
+        return ReprojectReport(doku);
+    if (name == "resolution")
+        return ResolutionReport(doku);
+    if (name == "startup")
+        return StartupReport(doku);
+    if (name == "cpu")
+        return CpuReport(doku);
+    if (name == "benchmark") {
+        DokuBenchmarkConfig config;
+        config.frames = 120;
+        return RunDokuBenchmark(doku, config);
+    }
+    return "unknown report: " + name + "\n";
+}
@@ -0,0 +1,117 @@
+#include "doku.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#ifdef __ANDROID__
+    #include <android/log.h>
+    #define LOG_TAG "DOKU_RENDER"
+    #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#else
+    #define LOGI(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+#endif
+
+// File layout: "DKPB", GLenum binary format, then the binary up to the end of the file.
+static constexpr char cacheMagic[4] = { 'D', 'K', 'P', 'B' };
+
+// FNV-1a
+static uint64_t Hash(const std::string& data, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string ProgramCache::Path(const std::string& sources) const {
+    auto renderer = (const char*)glGetString(GL_RENDERER);
+    auto version = (const char*)glGetString(GL_VERSION);
+    uint64_t hash = Hash(renderer ? renderer : "");
+    hash = Hash("\n", hash);
+    hash = Hash(version ? version : "", hash);
+    hash = Hash("\n", hash);
+    hash = Hash(sources, hash);
+
+    char name[32];
+    snprintf(name, sizeof(name), "/doku_%016llx.bin", (unsigned long long)hash);
+    return m_directory + name;
+}
+
+GLuint ProgramCache::Load(const std::string& sources, bool count) {
+    if (!Enabled())
+        return 0;
+    auto path = Path(sources);
+
+    std::vector<char> binary;
+    GLenum format = 0;
+    {
+        std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(path.c_str(), "rb"), fclose);
+        if (!file) {
+            if (count)
+                ++m_misses;
+            return 0;
+        }
+        char magic[4];
+        fseek(file.get(), 0, SEEK_END);
+        long size = ftell(file.get()) - (long)(sizeof(magic) + sizeof(format));
+        fseek(file.get(), 0, SEEK_SET);
+        if (size > 0 && fread(magic, sizeof(magic), 1, file.get()) == 1 && memcmp(magic, cacheMagic, sizeof(magic)) == 0 &&
+            fread(&format, sizeof(format), 1, file.get()) == 1) {
+            binary.resize(size);
+            if (fread(binary.data(), size, 1, file.get()) != 1)
+                binary.clear();
+        }
+    }
+
+    GLuint program = 0;
+    if (!binary.empty()) {
+        program = glCreateProgram();
+        glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    if (!program) {
+        LOGI("Dropping program binary %s", path.c_str());
+        remove(path.c_str());
+    }
+    if (count)
+        ++(program ? m_hits : m_misses);
+    return program;
+}
+
+void ProgramCache::Store(const std::string& sources, GLuint program) {
+    if (!Enabled())
+        return;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (formats == 0 || length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    if (length <= 0)
+        return;
+
+    // written under another name and renamed, so a crash can't leave half a binary
+    auto path = Path(sources);
+    auto temp = path + ".tmp";
+    bool written;
+    {
+        std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(temp.c_str(), "wb"), fclose);
+        if (!file)
+            return;
+        written = fwrite(cacheMagic, sizeof(cacheMagic), 1, file.get()) == 1 &&
+                  fwrite(&format, sizeof(format), 1, file.get()) == 1 &&
+                  fwrite(binary.data(), length, 1, file.get()) == 1;
+    }
+    if (!written || rename(temp.c_str(), path.c_str()) != 0)
+        remove(temp.c_str());
+}
@@ -0,0 +1,570 @@
+#include "doku.h"
+
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    #include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+#endif
+
+// CPU port of FRAG_SHADER_MAIN with KERNEL_SOURCE, SHADE_SOURCE and the SKIP_SPHERE bounds.
+// kernal() here turns the angles by doubling their cosine and sine three times instead of
+// atan/acos and sin/cos, which is the same power-8 map with only +, *, / and sqrt, so it
+// vectorises on every lane type below.
+
+// ================= Lanes =================
+// N floats in F, a mask of N lanes in M, and the operations the march needs.
+
+struct ScalarLanes {
+    static constexpr int N = 1;
+    static constexpr const char* NAME = "scalar";
+    using F = float;
+    using M = bool;
+
+    static F Set(float v) { return v; }
+    static F Load(const float* p) { return *p; }
+    static void Store(float* p, F v) { *p = v; }
+    static F Add(F a, F b) { return a + b; }
+    static F Sub(F a, F b) { return a - b; }
+    static F Mul(F a, F b) { return a * b; }
+    static F Div(F a, F b) { return a / b; }
+    static F Sqrt(F a) { return std::sqrt(a); }
+    static M Less(F a, F b) { return a < b; }
+    static M Greater(F a, F b) { return a > b; }
+    static M And(M a, M b) { return a && b; }
+    static M Or(M a, M b) { return a || b; }
+    static M AndNot(M a, M b) { return a && !b; }
+    static F Select(M m, F a, F b) { return m ? a : b; }
+    static int Bits(M m) { return m ? 1 : 0; }
+};
+
+#if defined(__AVX2__)
+struct SimdLanes {
+    static constexpr int N = 8;
+    static constexpr const char* NAME = "AVX2";
+    using F = __m256;
+    using M = __m256;
+
+    static F Set(float v) { return _mm256_set1_ps(v); }
+    static F Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, F v) { _mm256_storeu_ps(p, v); }
+    static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F Div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F Sqrt(F a) { return _mm256_sqrt_ps(a); }
+    static M Less(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M Greater(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M And(M a, M b) { return _mm256_and_ps(a, b); }
+    static M Or(M a, M b) { return _mm256_or_ps(a, b); }
+    static M AndNot(M a, M b) { return _mm256_andnot_ps(b, a); }
+    static F Select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+    static int Bits(M m) { return _mm256_movemask_ps(m); }
+};
+#elif defined(__SSE2__)
+struct SimdLanes {
+    static constexpr int N = 4;
+    static constexpr const char* NAME = "SSE2";
+    using F = __m128;
+    using M = __m128;
+
+    static F Set(float v) { return _mm_set1_ps(v); }
+    static F Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, F v) { _mm_storeu_ps(p, v); }
+    static F Add(F a, F b) { return _mm_add_ps(a, b); }
+    static F Sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F Mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F Div(F a, F b) { return _mm_div_ps(a, b); }
+    static F Sqrt(F a) { return _mm_sqrt_ps(a); }
+    static M Less(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static M Greater(F a, F b) { return _mm_cmpgt_ps(a, b); }
+    static M And(M a, M b) { return _mm_and_ps(a, b); }
+    static M Or(M a, M b) { return _mm_or_ps(a, b); }
+    static M AndNot(M a, M b) { return _mm_andnot_ps(b, a); }
+    static F Select(M m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static int Bits(M m) { return _mm_movemask_ps(m); }
+};
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+struct SimdLanes {
+    static constexpr int N = 4;
+    static constexpr const char* NAME = "NEON";
+    using F = float32x4_t;
+    using M = uint32x4_t;
+
+    static F Set(float v) { return vdupq_n_f32(v); }
+    static F Load(const float* p) { return vld1q_f32(p); }
+    static void Store(float* p, F v) { vst1q_f32(p, v); }
+    static F Add(F a, F b) { return vaddq_f32(a, b); }
+    static F Sub(F a, F b) { return vsubq_f32(a, b); }
+    static F Mul(F a, F b) { return vmulq_f32(a, b); }
+    static F Div(F a, F b) { return vdivq_f32(a, b); }
+    static F Sqrt(F a) { return vsqrtq_f32(a); }
+    static M Less(F a, F b) { return vcltq_f32(a, b); }
+    static M Greater(F a, F b) { return vcgtq_f32(a, b); }
+    static M And(M a, M b) { return vandq_u32(a, b); }
+    static M Or(M a, M b) { return vorrq_u32(a, b); }
+    static M AndNot(M a, M b) { return vbicq_u32(a, b); }
+    static F Select(M m, F a, F b) { return vbslq_f32(m, a, b); }
+    static int Bits(M m) {
+        static const uint32_t weights[4] = { 1, 2, 4, 8 };
+        return (int)vaddvq_u32(vandq_u32(m, vld1q_u32(weights)));
+    }
+};
+#else
+// 32-bit ARM NEON has no vector divide or square root, so it is not worth the lanes
+using SimdLanes = ScalarLanes;
+#endif
+
+// ================= WorkStealingPool =================
+
+// Runs tasks 0..count-1 on its threads and the calling one. Tasks are dealt out round-robin
+// to one queue per thread; a thread takes from the front of its own queue and, when that is
+// empty, from the back of the others', so a thread that drew slow tiles is relieved.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int threads) {
+        for (int i = 0; i < threads; ++i)
+            m_queues.emplace_back(new Queue);
+        // the caller works the last queue
+        for (int i = 0; i + 1 < threads; ++i)
+            m_threads.emplace_back([this, i] { Worker(i); });
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& thread : m_threads)
+            thread.join();
+    }
+
+    int Threads() const { return (int)m_queues.size(); }
+
+    void Run(int count, const std::function<void(int)>& task) {
+        if (count <= 0)
+            return;
+        // before any task is queued, a thread still leaving the last Run may pick one up
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = &task;
+            m_remaining = count;
+        }
+        for (int i = 0; i < count; ++i) {
+            auto& queue = *m_queues[i % m_queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(i);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        Work((int)m_queues.size() - 1);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_remaining == 0; });
+        m_task = nullptr;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    bool Pop(int self, int& task) {
+        int count = (int)m_queues.size();
+        for (int i = 0; i < count; ++i) {
+            auto& queue = *m_queues[(self + i) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+            if (i == 0) {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            } else {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void Work(int self) {
+        int task;
+        while (Pop(self, task)) {
+            (*m_task)(task);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_remaining == 0)
+                m_done.notify_all();
+        }
+    }
+
+    void Worker(int self) {
+        int seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+                if (m_stop)
+                    return;
+                seen = m_generation;
+            }
+            Work(self);
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    // set while Run is in progress; a popped task keeps Run from returning until it is done
+    const std::function<void(int)>* m_task = nullptr;
+    int m_remaining = 0;
+    int m_generation = 0;
+    bool m_stop = false;
+};
+
+// ================= march =================
+
+namespace {
+
+// What the shader gets from uniforms and #defines
+struct View {
+    float origin[3];
+    float right[3];
+    float up[3];
+    float forward[3];
+    float len;
+    float boundRadius;
+    float step;
+    int iterations;
+    int steps;
+    int refine;  // MAXR and SOLVER
+};
+
+constexpr float M_L = 0.3819660113f;
+constexpr float M_R = 0.6180339887f;
+constexpr int TILE = 32;
+
+// (cos, sin) of twice the angle
+template<class V>
+inline void DoubleAngle(typename V::F& c, typename V::F& s) {
+    auto c2 = V::Sub(V::Mul(c, c), V::Mul(s, s));
+    s = V::Mul(V::Set(2.0f), V::Mul(c, s));
+    c = c2;
+}
+
+template<class V>
+typename V::F Kernal(typename V::F x, typename V::F y, typename V::F z, int iterations) {
+    using F = typename V::F;
+    F ax = x, ay = y, az = z;
+    auto escaped = V::Less(V::Set(1.0f), V::Set(0.0f));
+    for (int i = 0; i < iterations; i++) {
+        F rho = V::Sqrt(V::Add(V::Mul(ax, ax), V::Mul(ay, ay)));
+        F r = V::Sqrt(V::Add(V::Mul(rho, rho), V::Mul(az, az)));
+        // atan(y, x) of the shader, taking atan(0, 0) as 0
+        auto offAxis = V::Greater(rho, V::Set(0.0f));
+        F cosC = V::Select(offAxis, V::Div(ax, rho), V::Set(1.0f));
+        F sinC = V::Select(offAxis, V::Div(ay, rho), V::Set(0.0f));
+        // acos(z / r), in [0, pi] so its sine is not negative
+        F cosD = V::Div(az, r);
+        F sinD = V::Div(rho, r);
+        for (int j = 0; j < 3; j++) {
+            DoubleAngle<V>(cosC, sinC);
+            DoubleAngle<V>(cosD, sinD);
+        }
+        F b = V::Mul(r, r);
+        b = V::Mul(b, b);
+        b = V::Mul(b, b);
+        // lanes that broke out of the loop keep their a
+        ax = V::Select(escaped, ax, V::Add(V::Mul(V::Mul(b, sinD), cosC), x));
+        ay = V::Select(escaped, ay, V::Add(V::Mul(V::Mul(b, sinD), sinC), y));
+        az = V::Select(escaped, az, V::Add(V::Mul(b, cosD), z));
+        escaped = V::Or(escaped, V::Greater(b, V::Set(6.0f)));
+        if (V::Bits(escaped) == (1 << V::N) - 1)
+            break;
+    }
+    return V::Sub(V::Sub(V::Sub(V::Set(4.0f), V::Mul(ax, ax)), V::Mul(ay, ay)), V::Mul(az, az));
+}
+
+float KernalAt(const View& view, float x, float y, float z) {
+    return Kernal<ScalarLanes>(x, y, z, view.iterations);
+}
+
+// kernal(origin + dir * t)
+float KernalAlong(const View& view, const float dir[3], float t) {
+    return KernalAt(view, view.origin[0] + dir[0] * t, view.origin[1] + dir[1] * t, view.origin[2] + dir[2] * t);
+}
+
+// The SOLVER loops: bisection between r1 outside and r2 inside
+float Bisect(const View& view, const float dir[3], float r1, float r2) {
+    float r3 = r2;
+    for (int l = 0; l < view.refine; l++) {
+        r3 = r1 * 0.5f + r2 * 0.5f;
+        if (KernalAlong(view, dir, r3) > 0.0f)
+            r2 = r3;
+        else
+            r1 = r3;
+    }
+    return r3;
+}
+
+// The body of the march loop at step k for one ray, once v, v1 and v2 showed a crossing or
+// a maximum below zero. Sets r3 and returns true where the shader sets sign.
+bool Refine(const View& view, const float dir[3], int k, float v, float v1, float v2, float& r3) {
+    float sl = view.step * view.len;
+    if (v > 0.0f && v1 < 0.0f) {
+        r3 = Bisect(view, dir, sl * float(k - 1), sl * float(k));
+        if (r3 < 2.0f * view.len)
+            return true;
+    }
+    if (v < v1 && v1 > v2 && v1 < 0.0f && (v1 * 2.0f > v || v1 * 2.0f > v2)) {
+        float r1 = sl * float(k - 2);
+        float r2 = sl * (float(k) - 2.0f + 2.0f * M_L);
+        r3 = sl * (float(k) - 2.0f + 2.0f * M_R);
+        float r4 = sl * float(k);
+        float m2 = KernalAlong(view, dir, r2);
+        float m3 = KernalAlong(view, dir, r3);
+        for (int l = 0; l < view.refine; l++) {
+            if (m2 > m3) {
+                r4 = r3;
+                r3 = r2;
+                r2 = r4 * M_L + r1 * M_R;
+                m3 = m2;
+                m2 = KernalAlong(view, dir, r2);
+            } else {
+                r1 = r2;
+                r2 = r3;
+                r3 = r4 * M_R + r1 * M_L;
+                m2 = m3;
+                m3 = KernalAlong(view, dir, r3);
+            }
+        }
+        if (m2 > 0.0f || m3 > 0.0f) {
+            r3 = Bisect(view, dir, sl * float(k - 2), m2 > 0.0f ? r2 : r3);
+            if (r3 < 2.0f * view.len && r3 > sl)
+                return true;
+        }
+    }
+    return false;
+}
+
+// shade() of the shader; color in 0-1, possibly above
+void Shade(const View& view, const float dir[3], const float localdir[3], float r3, float color[3]) {
+    float ver[3], n[3];
+    for (int c = 0; c < 3; c++)
+        ver[c] = view.origin[c] + dir[c] * r3;
+    float r1_sq = ver[0] * ver[0] + ver[1] * ver[1] + ver[2] * ver[2];
+    float e = r3 * 0.00025f;
+    auto kernalOffset = [&](const float axis[3], float scale) {
+        return KernalAt(view, ver[0] + axis[0] * scale, ver[1] + axis[1] * scale, ver[2] + axis[2] * scale);
+    };
+    n[0] = kernalOffset(view.right, -e) - kernalOffset(view.right, e);
+    n[1] = kernalOffset(view.up, -e) - kernalOffset(view.up, e);
+    n[2] = kernalOffset(view.forward, e) - kernalOffset(view.forward, -e);
+    float inv = 1.0f / std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    for (auto& c : n)
+        c *= inv;
+    float l[3];
+    inv = 1.0f / std::sqrt(localdir[0] * localdir[0] + localdir[1] * localdir[1] + localdir[2] * localdir[2]);
+    for (int c = 0; c < 3; c++)
+        l[c] = localdir[c] * inv;
+    float d = l[0] * n[0] + l[1] * n[1] + l[2] * n[2];
+    float reflect[3];
+    for (int c = 0; c < 3; c++)
+        reflect[c] = n[c] * (-2.0f * d) + l[c];
+    float r = reflect[0] * 0.276f + reflect[1] * 0.920f + reflect[2] * 0.276f;
+    float r4 = n[0] * 0.276f + n[1] * 0.920f + n[2] * 0.276f;
+    r = std::max(0.0f, r);
+    r = r * r * r * r;
+    r = r * 0.45f + r4 * 0.25f + 0.3f;
+    color[0] = (std::sin(r1_sq * 10.0f) * 0.5f + 0.5f) * r;
+    color[1] = (std::sin(r1_sq * 10.0f + 2.05f) * 0.5f + 0.5f) * r;
+    color[2] = (std::sin(r1_sq * 10.0f - 2.05f) * 0.5f + 0.5f) * r;
+}
+
+// Marches V::N rays side by side over the steps of the union of their ranges, each lane
+// only inside its own. Lanes past the image edge have count <= lane. Writes the hit
+// distance of each ray to hit, -1 on a miss.
+template<class V>
+void MarchLanes(const View& view, const float (&dir)[3][V::N], int count, float (&hit)[V::N]) {
+    using F = typename V::F;
+    constexpr int N = V::N;
+    float sl = view.step * view.len;
+
+    // boundingInterval() and the SKIP_BOUND step range, per lane
+    float kStart[N], kEnd[N], t1[N], t2[N];
+    int kMin = INT_MAX, kMax = INT_MIN;
+    for (int i = 0; i < N; i++) {
+        hit[i] = -1.0f;
+        int start = 2, end = 2;
+        if (i < count) {
+            float a = dir[0][i] * dir[0][i] + dir[1][i] * dir[1][i] + dir[2][i] * dir[2][i];
+            float b = view.origin[0] * dir[0][i] + view.origin[1] * dir[1][i] + view.origin[2] * dir[2][i];
+            float c = view.origin[0] * view.origin[0] + view.origin[1] * view.origin[1] +
+                      view.origin[2] * view.origin[2] - view.boundRadius * view.boundRadius;
+            float h = b * b - a * c;
+            if (h >= 0.0f) {
+                h = std::sqrt(h);
+                float tNear = (-b - h) / a, tFar = (-b + h) / a;
+                if (tFar >= 0.0f) {
+                    start = std::max(2, (int)std::floor(tNear / sl));
+                    end = std::min(view.steps + 2, (int)std::ceil(tFar / sl) + 3);
+                }
+            }
+        }
+        kStart[i] = (float)start;
+        kEnd[i] = (float)end;
+        t1[i] = sl * float(start - 1);
+        t2[i] = sl * float(start - 2);
+        if (start < end) {
+            kMin = std::min(kMin, start);
+            kMax = std::max(kMax, end);
+        }
+    }
+    if (kMin >= kMax)
+        return;
+
+    F dx = V::Load(dir[0]), dy = V::Load(dir[1]), dz = V::Load(dir[2]);
+    F ox = V::Set(view.origin[0]), oy = V::Set(view.origin[1]), oz = V::Set(view.origin[2]);
+    auto along = [&](F t) {
+        return Kernal<V>(V::Add(ox, V::Mul(dx, t)), V::Add(oy, V::Mul(dy, t)), V::Add(oz, V::Mul(dz, t)), view.iterations);
+    };
+    F v1 = along(V::Load(t1));
+    F v2 = along(V::Load(t2));
+    F kStartV = V::Load(kStart), kEndV = V::Load(kEnd);
+    F zero = V::Set(0.0f), two = V::Set(2.0f);
+    float doneLanes[N] = {};
+    auto done = V::Less(V::Set(1.0f), zero);
+
+    for (int k = kMin; k < kMax; k++) {
+        F kf = V::Set(float(k));
+        auto remaining = V::AndNot(V::Less(kf, kEndV), done);
+        if (!V::Bits(remaining))
+            break;
+        auto active = V::AndNot(remaining, V::Less(kf, kStartV));
+        if (!V::Bits(active))
+            continue;
+
+        F v = along(V::Set(sl * float(k)));
+        auto crossing = V::And(V::Greater(v, zero), V::Less(v1, zero));
+        auto maximum = V::And(V::And(V::Less(v, v1), V::Greater(v1, v2)),
+                              V::And(V::Less(v1, zero), V::Or(V::Greater(V::Mul(v1, two), v),
+                                                              V::Greater(V::Mul(v1, two), v2))));
+        int events = V::Bits(V::And(active, V::Or(crossing, maximum)));
+        if (events) {
+            float vs[N], v1s[N], v2s[N];
+            V::Store(vs, v);
+            V::Store(v1s, v1);
+            V::Store(v2s, v2);
+            for (int i = 0; i < N; i++) {
+                if (!(events & (1 << i)))
+                    continue;
+                float laneDir[3] = { dir[0][i], dir[1][i], dir[2][i] };
+                float r3;
+                if (Refine(view, laneDir, k, vs[i], v1s[i], v2s[i], r3)) {
+                    hit[i] = r3;
+                    doneLanes[i] = 1.0f;
+                }
+            }
+            done = V::Greater(V::Load(doneLanes), zero);
+        }
+        v2 = V::Select(active, v1, v2);
+        v1 = V::Select(active, v, v1);
+    }
+}
+
+// One TILE x TILE square of the image, rows bottom first
+template<class V>
+void RenderTile(const View& view, int size, int tile, unsigned char* pixels) {
+    constexpr int N = V::N;
+    int tilesPerRow = (size + TILE - 1) / TILE;
+    int x0 = tile % tilesPerRow * TILE, y0 = tile / tilesPerRow * TILE;
+    int x1 = std::min(x0 + TILE, size), y1 = std::min(y0 + TILE, size);
+
+    for (int y = y0; y < y1; y++) {
+        // position of the full-screen quad at the pixel center, x and y uniforms of 1
+        float py = (float(y) + 0.5f) * 2.0f / float(size) - 1.0f;
+        for (int x = x0; x < x1; x += N) {
+            float dir[3][N], px[N];
+            for (int i = 0; i < N; i++) {
+                px[i] = (float(x + i) + 0.5f) * 2.0f / float(size) - 1.0f;
+                for (int c = 0; c < 3; c++)
+                    dir[c][i] = view.forward[c] + view.right[c] * px[i] + view.up[c] * py;
+            }
+            float hit[N];
+            MarchLanes<V>(view, dir, x1 - x, hit);
+
+            for (int i = 0; i < N && x + i < x1; i++) {
+                float color[3] = {};
+                if (hit[i] >= 0.0f) {
+                    float laneDir[3] = { dir[0][i], dir[1][i], dir[2][i] };
+                    float localdir[3] = { px[i], py, -1.0f };
+                    Shade(view, laneDir, localdir, hit[i], color);
+                }
+                auto out = pixels + ((size_t)y * size + x + i) * 4;
+                for (int c = 0; c < 3; c++)
+                    out[c] = (unsigned char)(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+                out[3] = 255;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+// ================= CpuRenderer =================
+
+CpuRenderer::CpuRenderer(int threads) {
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    m_pool.reset(new WorkStealingPool(threads));
+}
+
+CpuRenderer::~CpuRenderer() = default;
+
+int CpuRenderer::Threads() const {
+    return m_pool->Threads();
+}
+
+const char* CpuRenderer::InstructionSet() {
+    return SimdLanes::NAME;
+}
+
+std::vector<unsigned char> CpuRenderer::Render(const RenderDoku& doku, int size, bool simd) {
+    auto camera = doku.GetCamera();
+    auto& quality = DOKU_QUALITY[doku.m_quality];
+    View view;
+    std::copy_n(camera.origin, 3, view.origin);
+    std::copy_n(camera.right, 3, view.right);
+    std::copy_n(camera.up, 3, view.up);
+    std::copy_n(camera.forward, 3, view.forward);
+    view.len = doku.len;
+    view.boundRadius = RenderDoku::BOUND_RADIUS;
+    view.step = quality.step;
+    view.iterations = quality.iterations;
+    view.steps = quality.steps;
+    view.refine = quality.refine;
+
+    std::vector<unsigned char> pixels((size_t)size * size * 4);
+    int tilesPerRow = (size + TILE - 1) / TILE;
+    m_pool->Run(tilesPerRow * tilesPerRow, [&](int tile) {
+        if (simd)
+            RenderTile<SimdLanes>(view, size, tile, pixels.data());
+        else
+            RenderTile<ScalarLanes>(view, size, tile, pixels.data());
+    });
+    return pixels;
+}
@@ -0,0 +1,86 @@
+#include "doku.h"
+
+// Command-line RunDokuBenchmark for Linux, e.g. CI on Mesa llvmpipe without a display.
+// Not part of the Android library; CMake builds it with -DFEATURETEST_DOKU_HEADLESS=ON,
+// add -DCMAKE_CXX_FLAGS=-mavx2 for AVX2 lanes in the CPU renderer.
+// Usage: doku_headless [--frames N] [--size WxH] [--render-size N] [--dump last.ppm] [--cache DIR] [--cpu] [key=value ...]
+// --size is the blit target; the march renders at its shorter side unless --render-size
+// says otherwise, either way at most FBO_SIZE.
+// The key=value arguments are RenderDoku options, such as shading=sphere or quality=low.
+// --cpu adds the "cpu" report; without a GLES context it runs the CPU renderer alone.
+// Exits with 1 if there is no GLES 3.1 context and no --cpu, 2 on a bad argument, 3 on a GL error.
+
+#ifndef __ANDROID__
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void Usage() {
+    fprintf(stderr, "usage: doku_headless [--frames N] [--size WxH] [--render-size N] [--dump FILE] [--cache DIR] [--cpu] [key=value ...]\n");
+}
+
+int main(int argc, char** argv) {
+    DokuBenchmarkConfig config;
+    std::string cacheDir;
+    bool cpu = false;
+    std::vector<std::string> options;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--frames") && hasValue) {
+            config.frames = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--size") && hasValue) {
+            ++i;
+            if (sscanf(argv[i], "%dx%d", &config.width, &config.height) == 1)
+                config.height = config.width;
+        } else if (!strcmp(argv[i], "--render-size") && hasValue) {
+            config.renderSize = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--dump") && hasValue) {
+            config.dumpPath = argv[++i];
+        } else if (!strcmp(argv[i], "--cache") && hasValue) {
+            cacheDir = argv[++i];
+        } else if (!strcmp(argv[i], "--cpu")) {
+            cpu = true;
+        } else if (strchr(argv[i], '=')) {
+            options.push_back(argv[i]);
+        } else {
+            Usage();
+            return 2;
+        }
+    }
+    if (config.frames <= 0 || config.width <= 0 || config.height <= 0 || config.renderSize < 0) {
+        Usage();
+        return 2;
+    }
+
+    GLEnv env;
+    bool gles = env.InitHeadless();
+    if (!gles) {
+        fprintf(stderr, "GLES 3.1 context not available\n");
+        if (!cpu)
+            return 1;
+        env.Destroy();
+    }
+
+    RenderDoku doku;
+    if (!cacheDir.empty())
+        doku.SetCacheDirectory(cacheDir);
+    if (gles)
+        doku.Init();
+    for (auto& option : options) {
+        if (!doku.SetOption(option)) {
+            fprintf(stderr, "unknown option: %s\n", option.c_str());
+            return 2;
+        }
+    }
+
+    std::string report;
+    if (gles)
+        report = RunDokuBenchmark(doku, config);
+    if (cpu)
+        report += RunDokuReport(doku, "cpu");
+    fputs(report.c_str(), stdout);
+    return report.find("GL error") == std::string::npos ? 0 : 3;
+}
+
+#endif
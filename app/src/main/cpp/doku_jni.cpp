@@ -2,12 +2,14 @@
 #include <android/native_window_jni.h>
 #include "doku.h"
 
+#include <memory>
+
 // Static instances to maintain state across JNI calls
 static GLEnv* g_glEnv = nullptr;
 static RenderDoku* g_renderDoku = nullptr;
 
 extern "C" JNIEXPORT void JNICALL
-Java_net_sorayuki_featuretest_DokuKinokoActivity_nativeInit(JNIEnv* env, jobject /* this */, jobject surface) {
+Java_net_sorayuki_featuretest_DokuKinokoActivity_nativeInit(JNIEnv* env, jobject /* this */, jobject surface, jstring cacheDir) {
     if (g_glEnv) {
         delete g_glEnv;
     }
@@ -17,6 +19,13 @@ Java_net_sorayuki_featuretest_DokuKinokoActivity_nativeInit(JNIEnv* env, jobject
 
     g_glEnv = new GLEnv();
     g_renderDoku = new RenderDoku();
+    {
+        jboolean isCopy = JNI_FALSE;
+        auto strCacheDir = env->GetStringUTFChars(cacheDir, &isCopy);
+        g_renderDoku->SetCacheDirectory(strCacheDir);
+        if (isCopy == JNI_TRUE)
+            env->ReleaseStringUTFChars(cacheDir, strCacheDir);
+    }
 
     ANativeWindow* window = ANativeWindow_fromSurface(env, surface);
     if (g_glEnv->Init(window)) {
@@ -48,6 +57,19 @@ Java_net_sorayuki_featuretest_DokuKinokoActivity_nativeRender(JNIEnv* env, jobje
     }
 }
 
+// Latest GPU ms of each DokuPass, in its order
+extern "C" JNIEXPORT jdoubleArray JNICALL
+Java_net_sorayuki_featuretest_DokuKinokoActivity_nativeGpuTimes(JNIEnv* env, jobject /* this */) {
+    jdouble times[DOKU_PASS_COUNT] = {};
+    if (g_renderDoku) {
+        for (int i = 0; i < DOKU_PASS_COUNT; ++i)
+            times[i] = g_renderDoku->PassGpuMs((DokuPass)i);
+    }
+    jdoubleArray result = env->NewDoubleArray(DOKU_PASS_COUNT);
+    env->SetDoubleArrayRegion(result, 0, DOKU_PASS_COUNT, times);
+    return result;
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_net_sorayuki_featuretest_DokuKinokoActivity_nativeDestroy(JNIEnv* env, jobject /* this */) {
     if (g_renderDoku) {
@@ -60,3 +82,33 @@ Java_net_sorayuki_featuretest_DokuKinokoActivity_nativeDestroy(JNIEnv* env, jobj
         g_glEnv = nullptr;
     }
 }
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_net_sorayuki_featuretest_DokuKinokoActivity_nativeSetOption(JNIEnv* env, jobject /* this */, jstring option) {
+    if (!g_renderDoku) {
+        return JNI_FALSE;
+    }
+    jboolean isCopy = JNI_FALSE;
+    auto strOption = env->GetStringUTFChars(option, &isCopy);
+    std::shared_ptr<int> guard{(int*)1024, [=](int*){
+        if (isCopy == JNI_TRUE)
+            env->ReleaseStringUTFChars(option, strOption);
+    }};
+
+    return g_renderDoku->SetOption(strOption) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jstring JNICALL
+Java_net_sorayuki_featuretest_DokuKinokoActivity_nativeReport(JNIEnv* env, jobject /* this */, jstring name) {
+    if (!g_renderDoku) {
+        return env->NewStringUTF("renderer not running");
+    }
+    jboolean isCopy = JNI_FALSE;
+    auto strName = env->GetStringUTFChars(name, &isCopy);
+    std::shared_ptr<int> guard{(int*)1024, [=](int*){
+        if (isCopy == JNI_TRUE)
+            env->ReleaseStringUTFChars(name, strName);
+    }};
+
+    return env->NewStringUTF(RunDokuReport(*g_renderDoku, strName).c_str());
+}
@@ -0,0 +1,126 @@
+#include "doku.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+// ================= GpuTimer =================
+
+GpuTimer::~GpuTimer() {
+    if (m_hasQuery)
+        glDeleteQueries(RING, m_queries);
+}
+
+void GpuTimer::Init() {
+    auto extensions = (const char*)glGetString(GL_EXTENSIONS);
+    m_getQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress("glGetQueryObjectui64vEXT");
+    m_hasQuery = extensions && strstr(extensions, "GL_EXT_disjoint_timer_query") && m_getQueryObjectui64v;
+    if (m_hasQuery)
+        glGenQueries(RING, m_queries);
+}
+
+void GpuTimer::Begin() {
+    if (m_hasQuery) {
+        // all slots still in flight: skip this frame rather than wait
+        m_active = m_pending < RING;
+        if (m_active)
+            glBeginQuery(GL_TIME_ELAPSED_EXT, m_queries[m_head]);
+        return;
+    }
+
+    m_active = m_frame++ % FALLBACK_INTERVAL == 0;
+    if (m_active) {
+        glFinish();
+        m_start = std::chrono::high_resolution_clock::now();
+    }
+}
+
+void GpuTimer::End() {
+    if (!m_active)
+        return;
+    m_active = false;
+
+    if (m_hasQuery) {
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+        m_head = (m_head + 1) % RING;
+        ++m_pending;
+        return;
+    }
+
+    glFinish();
+    m_fallbackMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_start).count();
+}
+
+bool GpuTimer::Poll(double& ms) {
+    if (!m_hasQuery) {
+        if (m_fallbackMs < 0)
+            return false;
+        ms = m_fallbackMs;
+        m_fallbackMs = -1;
+        return !std::exchange(m_first, false);
+    }
+
+    if (m_pending == 0)
+        return false;
+    GLuint query = m_queries[(m_head - m_pending + RING) % RING];
+    GLuint available = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return false;
+    --m_pending;
+
+    GLuint64 ns = 0;
+    m_getQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+    // frequency change or context loss somewhere in between, the value means nothing
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint)
+        return false;
+    ms = ns / 1000000.0;
+    // the first frame also compiles its programs, and some drivers report nonsense for
+    // the first query of a context
+    return !std::exchange(m_first, false);
+}
+
+// ================= ResolutionController =================
+
+int ResolutionController::Update(double gpuMs) {
+    ++m_samples;
+    if (m_samples <= DISCARD_SAMPLES)
+        return m_size;
+    m_smoothedMs = m_samples == DISCARD_SAMPLES + 1 ? gpuMs : m_smoothedMs * 0.8 + gpuMs * 0.2;
+    if (m_samples < SETTLE_SAMPLES)
+        return m_size;
+
+    double ratio = m_smoothedMs / m_targetMs;
+    if (ratio <= SHRINK_ABOVE && ratio >= GROW_BELOW)
+        return m_size;
+
+    // aim under the target, so the next frames land inside the band
+    double scale = std::min(std::sqrt(AIM / ratio), MAX_GROWTH);
+    int size = (int)(m_size * scale) / ALIGN * ALIGN;
+    size = std::max(m_minSize, std::min(m_maxSize, size));
+    if (size != m_size) {
+        m_size = size;
+        m_samples = 0;
+    }
+    return m_size;
+}
+
+// ================= FrameStats =================
+
+FrameStats GetFrameStats(std::vector<double> frameMs) {
+    FrameStats stats;
+    if (frameMs.empty())
+        return stats;
+    std::sort(frameMs.begin(), frameMs.end());
+    auto at = [&](size_t percent) { return frameMs[std::min(frameMs.size() - 1, frameMs.size() * percent / 100)]; };
+    for (auto ms : frameMs)
+        stats.mean += ms;
+    stats.mean /= frameMs.size();
+    stats.p50 = at(50);
+    stats.p90 = at(90);
+    stats.p99 = at(99);
+    stats.max = frameMs.back();
+    return stats;
+}
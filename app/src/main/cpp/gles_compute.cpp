@@ -0,0 +1,265 @@
+#include "opencl_test.h"
+#include "opencl_test_cases.h"
+#include "doku.h"
+
+#include <sstream>
+#include <iomanip>
+
+// GLES 3.1 compute counterparts of TestCopyClass and TestFlopsClass.
+// Same sizes, same loop counts and the same ops convention, on an offscreen GLEnv, so the
+// numbers line up with the OpenCL ones and show which API is the faster path on a device.
+// Timing is host wall time around the dispatches plus glFinish, like RunTest.
+
+static GLuint CreateComputeProgram(const char* source) {
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint compiled;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        GLint infoLen = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
+        std::vector<char> infoLog(infoLen + 1);
+        glGetShaderInfoLog(shader, infoLen, nullptr, infoLog.data());
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", infoLog.data());
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+
+    GLint linked;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        GLint infoLen = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen);
+        std::vector<char> infoLog(infoLen + 1);
+        glGetProgramInfoLog(program, infoLen, nullptr, infoLog.data());
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", infoLog.data());
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+struct GLComputeTest {
+    GLuint program = 0;
+    std::vector<GLuint> buffers;
+
+    virtual ~GLComputeTest() {
+        if (program)
+            glDeleteProgram(program);
+        if (!buffers.empty())
+            glDeleteBuffers((GLsizei)buffers.size(), buffers.data());
+    }
+
+    virtual bool Prepare() = 0;
+    virtual void Dispatch() = 0;
+
+    // return: cost in milliseconds
+    double Run(int loopCount) {
+        using clock = std::chrono::high_resolution_clock;
+        auto start = clock::now();
+        for (int i = 0; i < loopCount; ++i) {
+            CheckCancelled();
+            Dispatch();
+        }
+        glFinish();
+        return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    }
+};
+
+struct GLCopyTest: GLComputeTest {
+    // one invocation moves 64 bytes like one uint16 work-item, as four uvec4
+    static constexpr size_t bufferBytes = TestCopyClass::BUFFER_SIZE * TestCopyClass::MB * sizeof(cl_uint16);
+    static constexpr GLuint groupSize = 64;
+    static constexpr GLuint invocations = TestCopyClass::BUFFER_SIZE * TestCopyClass::MB;
+
+    static constexpr const char* src = R"__(#version 310 es
+layout(local_size_x = 64) in;
+layout(std430, binding = 0) readonly buffer Src { uvec4 src[]; };
+layout(std430, binding = 1) writeonly buffer Dst { uvec4 dst[]; };
+void main() {
+    uint base = gl_GlobalInvocationID.x * 4u;
+    dst[base] = src[base];
+    dst[base + 1u] = src[base + 1u];
+    dst[base + 2u] = src[base + 2u];
+    dst[base + 3u] = src[base + 3u];
+}
+)__";
+
+    bool Prepare() override {
+        program = CreateComputeProgram(src);
+        if (!program)
+            return false;
+
+        buffers.resize(2);
+        glGenBuffers(2, buffers.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bufferBytes, nullptr, GL_STATIC_DRAW);
+        auto pBuffer = (cl_uint*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, bufferBytes,
+                                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!pBuffer)
+            return false;
+        fill_random(pBuffer, bufferBytes / sizeof(cl_uint));
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bufferBytes, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return glGetError() == GL_NO_ERROR;
+    }
+
+    void Dispatch() override {
+        glUseProgram(program);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[1]);
+        glDispatchCompute(invocations / groupSize, 1, 1);
+    }
+};
+
+struct GLFlopsTest: GLComputeTest {
+    // 65536 groups is one past the guaranteed GL_MAX_COMPUTE_WORK_GROUP_COUNT, so dispatch 2D
+    static constexpr GLuint groupSize = 64;
+    static constexpr GLuint groupsX = 1024;
+    static constexpr GLuint groupsY = TestFlopsClass::globalSize / groupSize / groupsX;
+
+    GLint loopsLocation = -1;
+
+    // the half16 of the OpenCL kernel becomes four mediump vec4; output is float since
+    // SSBOs have no 16-bit storage in ES 3.1
+    static constexpr const char* src = R"__(#version 310 es
+layout(local_size_x = 64) in;
+layout(std430, binding = 0) writeonly buffer Out { float outbuf[]; };
+uniform int loops;
+void main() {
+    uint id = gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x + gl_GlobalInvocationID.x;
+    mediump float val = float(id & 0xFFu) * 0.001;
+
+    // distinct seeds, or the compiler may fold the four chains into one
+    mediump vec4 a0 = vec4(val), a1 = vec4(val + 1.0), a2 = vec4(val + 2.0), a3 = vec4(val + 3.0);
+    mediump vec4 b = vec4(1.001);
+    mediump vec4 c = vec4(0.5);
+
+    mediump vec4 sum0 = vec4(0.0);
+    mediump vec4 sum1 = vec4(0.0);
+    mediump vec4 sum2 = vec4(0.0);
+    mediump vec4 sum3 = vec4(0.0);
+
+    for (int i = 0; i < loops; ++i) {
+        // 32 dots per loop, 8 ops each, as in compute_flops
+        sum0.x += dot(a0, b) + dot(a1, b);
+        sum0.y += dot(a2, b) + dot(a3, b);
+        sum0.z += dot(a0, b.wzyx) + dot(a1, b.wzyx);
+        sum0.w += dot(a2, b.yxwz) + dot(a3, b.yxwz);
+
+        sum1.x += dot(a0, c) + dot(a1, c);
+        sum1.y += dot(a2, c) + dot(a3, c);
+        sum1.z += dot(a0, c.wzyx) + dot(a1, c.wzyx);
+        sum1.w += dot(a2, c.yxwz) + dot(a3, c.yxwz);
+
+        a0 += vec4(0.0001);
+        a1 += vec4(0.0001);
+        a2 += vec4(0.0001);
+        a3 += vec4(0.0001);
+
+        sum2.x += dot(a0.xzyw, b) + dot(a1.ywxz, b);
+        sum2.y += dot(a2.zxwy, b) + dot(a3.wyzx, b);
+        sum2.z += dot(a0, a3.wzyx) + dot(a3, a0.wzyx);
+        sum2.w += dot(a1, a2.wzyx) + dot(a2, a1.wzyx);
+
+        sum3.x += dot(a0, c) + dot(a1, c);
+        sum3.y += dot(a2, c) + dot(a3, c);
+        sum3.z += dot(a0, c.wzyx) + dot(a1, c.wzyx);
+        sum3.w += dot(a2, c.yxwz) + dot(a3, c.yxwz);
+    }
+
+    mediump vec4 total = sum0 + sum1 + sum2 + sum3;
+    outbuf[id] = total.x + total.y + total.z + total.w;
+}
+)__";
+
+    bool Prepare() override {
+        program = CreateComputeProgram(src);
+        if (!program)
+            return false;
+        loopsLocation = glGetUniformLocation(program, "loops");
+
+        buffers.resize(1);
+        glGenBuffers(1, buffers.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, TestFlopsClass::globalSize * sizeof(float), nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return glGetError() == GL_NO_ERROR;
+    }
+
+    void Dispatch() override {
+        glUseProgram(program);
+        glUniform1i(loopsLocation, TestFlopsClass::innerLoop);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
+        glDispatchCompute(groupsX, groupsY, 1);
+    }
+};
+
+std::string RunGLComputeBenchmark(OpenCLTest* ptr) {
+    // loop counts of RunComputeTest
+    static constexpr int copyLoops = 300;
+    static constexpr int flopsLoops = 10;
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    double clCopy = 0, clFlops = 0;
+    try {
+        clCopy = RunComputeTest(ptr, "copy");
+        clFlops = RunComputeTest(ptr, "flops") / 1000000000.0;
+    } catch(const cl::Error& e) {
+        std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+        report << "OpenCL failed: " << msg << "\n";
+    }
+    ReportProgress(0.5, report.str());
+
+    double glCopy = 0, glFlops = 0;
+    {
+        // the context is current on this thread only, and released before returning
+        GLEnv env;
+        if (!env.InitOffscreen()) {
+            report << "GLES 3.1 context not available\n";
+        } else {
+            report << "OpenCL: " << ptr->device.getInfo<CL_DEVICE_NAME>() << "\n";
+            report << "GLES: " << (const char*)glGetString(GL_RENDERER) << "\n";
+
+            GLCopyTest copy;
+            if (copy.Prepare()) {
+                copy.Run(1);
+                double costMs = copy.Run(copyLoops);
+                glCopy = TestCopyClass::BUFFER_SIZE * sizeof(cl_uint16) * copyLoops * 1000.0 / costMs;
+            } else {
+                report << "GLES copy setup failed\n";
+            }
+
+            GLFlopsTest flops;
+            if (flops.Prepare()) {
+                flops.Run(1);
+                double costMs = flops.Run(flopsLoops);
+                double totalFlops = 256.0 * TestFlopsClass::innerLoop * TestFlopsClass::globalSize * flopsLoops;
+                glFlops = totalFlops * 1000.0 / costMs / 1000000000.0;
+            } else {
+                report << "GLES flops setup failed\n";
+            }
+        }
+    }
+
+    report << "test  OpenCL  GLES  GLES/OpenCL\n";
+    report << "copy_MB/s  " << clCopy << "  " << glCopy << "  " << (clCopy > 0 ? glCopy / clCopy : 0) << "\n";
+    report << "GFLOPS  " << clFlops << "  " << glFlops << "  " << (clFlops > 0 ? glFlops / clFlops : 0) << "\n";
+    report << "GLES flops use mediump, which drivers may or may not run at half precision\n";
+
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
@@ -0,0 +1,145 @@
+#include "opencl_test.h"
+#include "opencl_test_cases.h"
+#include "doku.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Compute-while-rendering interference.
+// One thread renders RenderDoku frames on an offscreen GLEnv while this thread keeps an
+// OpenCL TestCase busy, the way background compute shares the GPU with UI rendering.
+// Frame times and compute throughput are compared with each running alone.
+
+static constexpr int warmupFrames = 5;
+static constexpr int measuredFrames = 120;
+static constexpr int pbufferSize = 1024;
+
+// Renders on its own thread and context until measuredFrames were timed or stop is set.
+class RenderThread {
+public:
+    void Start() {
+        m_thread = std::thread([this] { Loop(); });
+    }
+
+    // blocks until the thread is gone; returns false if GL could not be set up
+    bool Join() {
+        if (m_thread.joinable())
+            m_thread.join();
+        return m_ok;
+    }
+
+    void Stop() { m_stop = true; }
+    bool Done() const { return m_done; }
+    const std::vector<double>& FrameMs() const { return m_frameMs; }
+
+private:
+    void Loop() {
+        using clock = std::chrono::high_resolution_clock;
+        {
+            GLEnv env;
+            RenderDoku doku;
+            if (env.InitOffscreen(pbufferSize, pbufferSize)) {
+                doku.Init();
+                doku.Resize(pbufferSize, pbufferSize);
+                // same work every frame, the frame times are what is measured
+                doku.SetDynamicResolution(false);
+                m_ok = glGetError() == GL_NO_ERROR;
+            }
+            for (int i = 0; m_ok && !m_stop && i < warmupFrames + measuredFrames; ++i) {
+                auto start = clock::now();
+                doku.Tick();
+                doku.Render();
+                glFinish();
+                if (i >= warmupFrames)
+                    m_frameMs.push_back(std::chrono::duration<double, std::milli>(clock::now() - start).count());
+            }
+        }
+        m_done = true;
+    }
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop{ false };
+    std::atomic<bool> m_done{ false };
+    bool m_ok = false;
+    std::vector<double> m_frameMs;
+};
+
+// Runs T one kernel batch at a time, for `batches` batches or, with a render thread,
+// until it finished. Returns work units per second, `perLoop` units per loop.
+template<class T>
+static double ComputeThroughput(OpenCLTest* ptr, double perLoop, int batches, RenderThread* render) {
+    static constexpr int batchLoops = 2;
+    T tc(ptr);
+    tc.Prepare();
+    TimeRun(tc, 1);
+
+    double totalMs = 0;
+    int done = 0;
+    while (render ? !render->Done() || done == 0 : done < batches) {
+        totalMs += TimeRun(tc, batchLoops);
+        ++done;
+    }
+    return perLoop * batchLoops * done * 1000.0 / totalMs;
+}
+
+template<class T>
+static void MeasureInterference(OpenCLTest* ptr, const char* name, double perLoop, const FrameStats& alone,
+                                std::stringstream& report) {
+    try {
+        double computeAlone = ComputeThroughput<T>(ptr, perLoop, 5, nullptr);
+
+        RenderThread render;
+        render.Start();
+        double computeShared;
+        try {
+            computeShared = ComputeThroughput<T>(ptr, perLoop, 0, &render);
+        } catch(...) {
+            // cancelled or failed, the render thread must not outlive this frame
+            render.Stop();
+            render.Join();
+            throw;
+        }
+        render.Join();
+        auto shared = GetFrameStats(render.FrameMs());
+
+        report << "render+" << name << "  " << shared.p50 << "  " << shared.p90 << "  "
+               << shared.p99 << "  " << shared.max << "\n";
+        report << "  frame p50 +" << (shared.p50 / alone.p50 - 1.0) * 100.0 << "%, p99 +"
+               << (shared.p99 / alone.p99 - 1.0) * 100.0 << "%; " << name << " "
+               << computeAlone << " -> " << computeShared << " ("
+               << computeShared / computeAlone * 100.0 << "% of alone)\n";
+    } catch(const cl::Error& e) {
+        std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+        report << name << "  failed: " << msg << "\n";
+    }
+}
+
+std::string RunInterferenceBenchmark(OpenCLTest* ptr) {
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    RenderThread render;
+    render.Start();
+    if (!render.Join()) {
+        report << "GLES 3.1 context not available\n";
+        return report.str();
+    }
+    auto alone = GetFrameStats(render.FrameMs());
+    report << "frame_ms  p50  p90  p99  max\n";
+    report << "render  " << alone.p50 << "  " << alone.p90 << "  " << alone.p99 << "  " << alone.max << "\n";
+    ReportProgress(1.0 / 3, report.str());
+
+    // copy in MB/s and flops in GFLOPS, the units of RunComputeTest
+    double copyMB = TestCopyClass::BUFFER_SIZE * sizeof(cl_uint16);
+    MeasureInterference<TestCopyClass>(ptr, "copy_MB/s", copyMB, alone, report);
+    ReportProgress(2.0 / 3, report.str());
+    double flopsG = 256.0 * TestFlopsClass::innerLoop * TestFlopsClass::globalSize / 1000000000.0;
+    MeasureInterference<TestFlopsClass>(ptr, "GFLOPS", flopsG, alone, report);
+
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
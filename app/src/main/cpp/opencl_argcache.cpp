@@ -0,0 +1,60 @@
+#include "opencl_test.h"
+#include "opencl_test_cases.h"
+
+#include <sstream>
+#include <iomanip>
+
+// Kernel argument caching.
+// Launch-heavy loops bind the same buffers every iteration; compare the host cost of
+// cl::KernelFunctor (clSetKernelArg per argument per launch) with CachedKernelFunctor.
+
+template<class T>
+static void CompareArgCache(OpenCLTest* ptr, const char* name, int loopCount, std::stringstream& report) {
+    using clock = std::chrono::high_resolution_clock;
+    try {
+        double enqueueUs[2] = {};
+        double totalMs[2] = {};
+        size_t setArgCalls = 0;
+        bool valid = true;
+        for (int cached = 0; cached < 2; ++cached) {
+            T tc(ptr);
+            tc.cachedArgs = cached != 0;
+            tc.Prepare();
+            // warm up, also creates the cached functor
+            TimeRun(tc, 1);
+
+            auto start = clock::now();
+            auto events = tc.Run(loopCount);
+            auto enqueued = clock::now();
+            cl::WaitForEvents(events);
+            auto finished = clock::now();
+
+            enqueueUs[cached] = std::chrono::duration<double, std::micro>(enqueued - start).count() / loopCount;
+            totalMs[cached] = std::chrono::duration<double, std::milli>(finished - start).count();
+            if (cached)
+                setArgCalls = tc.cachedKernel->setArgCalls();
+            valid &= tc.Verify();
+        }
+        report << name << "  " << enqueueUs[0] << "  " << enqueueUs[1] << "  "
+               << totalMs[0] << "  " << totalMs[1] << "  " << setArgCalls;
+        if (!valid)
+            report << "  invalid";
+        report << "\n";
+    } catch(const cl::Error& e) {
+        std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+        report << name << "  failed: " << msg << "\n";
+    }
+}
+
+std::string RunArgCacheBenchmark(OpenCLTest* ptr) {
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "test  enqueue_us  cached_us  total_ms  cached_ms  setArg_calls (cached, all launches)\n";
+
+    CompareArgCache<TestLaunchClass>(ptr, "launch", 2000, report);
+    CompareArgCache<TestCopyClass>(ptr, "copy", 300, report);
+
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
@@ -0,0 +1,199 @@
+#include "opencl_buffer_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <random>
+
+BufferPool& BufferPool::Instance() {
+    static BufferPool pool;
+    return pool;
+}
+
+size_t BufferPool::SizeClass(size_t size) {
+    static constexpr size_t minClass = 4096;
+    if (size <= minClass)
+        return minClass;
+    size_t p = minClass;
+    while (p * 2 <= size)
+        p *= 2;
+    size_t step = p / 4;
+    return (size + step - 1) / step * step;
+}
+
+cl::Buffer BufferPool::Acquire(const cl::Context& context, cl_mem_flags flags, size_t size) {
+    Key key{ context(), flags, SizeClass(size) };
+    cl::Buffer buffer;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_retainLimit.count(context())) {
+            // device queries stay outside the lock
+            lock.unlock();
+            size_t limit = 0;
+            for (auto& device : context.getInfo<CL_CONTEXT_DEVICES>()) {
+                size_t bytes = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / retainDivisor;
+                limit = limit ? (std::min)(limit, bytes) : bytes;
+            }
+            lock.lock();
+            m_retainLimit[context()] = limit;
+        }
+        ++m_stats.acquires;
+        auto it = m_free.find(key);
+        if (it != m_free.end() && !it->second.empty()) {
+            buffer = std::move(it->second.back());
+            it->second.pop_back();
+            ++m_stats.hits;
+            m_stats.bytesRetained -= std::get<2>(key);
+        } else {
+            ++m_stats.misses;
+        }
+    }
+
+    // create outside the lock, it is the slow part
+    if (!buffer())
+        buffer = cl::Buffer(context, flags, std::get<2>(key));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_outstanding[buffer()] = { key, size };
+    m_stats.bytesInUse += std::get<2>(key);
+    m_stats.bytesRequested += size;
+    return buffer;
+}
+
+void BufferPool::Release(const cl::Buffer& buffer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_outstanding.find(buffer());
+    if (it == m_outstanding.end())
+        return;
+
+    auto key = it->second.key;
+    m_stats.bytesInUse -= std::get<2>(key);
+    m_stats.bytesRequested -= it->second.requested;
+    m_outstanding.erase(it);
+
+    size_t limit = maxRetainedBytes ? maxRetainedBytes : m_retainLimit[std::get<0>(key)];
+    if (m_stats.bytesRetained + std::get<2>(key) > limit)
+        return;
+    m_free[key].push_back(buffer);
+    m_stats.bytesRetained += std::get<2>(key);
+}
+
+void BufferPool::Trim(size_t maxBytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // drop the largest classes first, they give memory back fastest
+    for (auto it = m_free.rbegin(); it != m_free.rend() && m_stats.bytesRetained > maxBytes; ++it) {
+        auto& list = it->second;
+        while (!list.empty() && m_stats.bytesRetained > maxBytes) {
+            list.pop_back();
+            m_stats.bytesRetained -= std::get<2>(it->first);
+        }
+    }
+}
+
+void BufferPool::Clear(const cl::Context& context) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_retainLimit.erase(context());
+    for (auto it = m_free.begin(); it != m_free.end();) {
+        if (std::get<0>(it->first) == context()) {
+            m_stats.bytesRetained -= std::get<2>(it->first) * it->second.size();
+            it = m_free.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = m_outstanding.begin(); it != m_outstanding.end();) {
+        if (std::get<0>(it->second.key) == context()) {
+            m_stats.bytesInUse -= std::get<2>(it->second.key);
+            m_stats.bytesRequested -= it->second.requested;
+            it = m_outstanding.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+BufferPool::Stats BufferPool::GetStats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void BufferPool::ResetCounters() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.acquires = 0;
+    m_stats.hits = 0;
+    m_stats.misses = 0;
+}
+
+std::string RunBufferPoolBenchmark(OpenCLTest* ptr) {
+    static constexpr size_t sizes[] = { 4 * 1024, 256 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024 };
+    static constexpr int frames = 50;
+    using clock = std::chrono::high_resolution_clock;
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    auto& pool = BufferPool::Instance();
+    auto queue = ptr->createQueue();
+    cl_uint pattern = 0;
+
+    // what this benchmark leaves idle is nothing the other tests would reuse
+    std::shared_ptr<int> trim{(int*)1024, [&](int*){ pool.Trim(0); }};
+
+    // every frame creates, touches and drops one buffer, like per-frame production code
+    report << "us/frame: size  create+release  pooled\n";
+    try {
+        for (auto size : sizes) {
+            auto start = clock::now();
+            for (int f = 0; f < frames; ++f) {
+                CheckCancelled();
+                cl::Buffer buf(ptr->context, CL_MEM_READ_WRITE, size);
+                queue.enqueueFillBuffer(buf, pattern, 0, sizeof(pattern));
+                queue.finish();
+            }
+            double rawUs = std::chrono::duration<double, std::micro>(clock::now() - start).count() / frames;
+
+            start = clock::now();
+            for (int f = 0; f < frames; ++f) {
+                CheckCancelled();
+                auto buf = pool.Acquire(ptr->context, CL_MEM_READ_WRITE, size);
+                queue.enqueueFillBuffer(buf, pattern, 0, sizeof(pattern));
+                queue.finish();
+                pool.Release(buf);
+            }
+            double pooledUs = std::chrono::duration<double, std::micro>(clock::now() - start).count() / frames;
+
+            report << size / 1024 << "K  " << rawUs << "  " << pooledUs << "\n";
+        }
+
+        // mixed sizes with several buffers alive per frame, to see hit rate and rounding waste
+        pool.ResetCounters();
+        std::mt19937 rand(4321);
+        std::uniform_int_distribution<size_t> sizeDist(1024, 8 * 1024 * 1024);
+        size_t peakInUse = 0;
+        double peakFragmentation = 0;
+        for (int f = 0; f < frames; ++f) {
+            CheckCancelled();
+            std::vector<cl::Buffer> live;
+            for (int i = 0; i < 8; ++i)
+                live.push_back(pool.Acquire(ptr->context, CL_MEM_READ_WRITE, sizeDist(rand)));
+            auto stats = pool.GetStats();
+            peakInUse = std::max(peakInUse, stats.bytesInUse);
+            peakFragmentation = std::max(peakFragmentation, stats.Fragmentation());
+            for (auto& buf : live)
+                pool.Release(buf);
+        }
+        auto stats = pool.GetStats();
+        report << "mixed: acquires " << stats.acquires << "  hits " << stats.hits
+               << " (" << 100.0 * stats.hits / stats.acquires << "%)\n";
+        report << "retained " << stats.bytesRetained / 1024 << "K  peak in use " << peakInUse / 1024
+               << "K  fragmentation " << peakFragmentation * 100.0 << "%\n";
+    } catch(const cl::Error& e) {
+        std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+        report << "failed: " << msg << "\n";
+    }
+
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "opencl_test.h"
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+
+// Size-class pool of cl::Buffer.
+// clCreateBuffer plus the first touch can cost milliseconds on some drivers, so buffers
+// released here are kept per (context, flags, size class) and handed out again instead
+// of being freed. A buffer must only be released once every command using it finished.
+class BufferPool {
+public:
+    struct Stats {
+        size_t acquires = 0;
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t bytesRetained = 0;   // idle buffers kept for reuse
+        size_t bytesInUse = 0;      // size-class bytes handed out
+        size_t bytesRequested = 0;  // what the callers actually asked for
+
+        // share of handed-out bytes lost to rounding up to a size class
+        double Fragmentation() const {
+            return bytesInUse ? 1.0 - (double)bytesRequested / bytesInUse : 0.0;
+        }
+    };
+
+    static BufferPool& Instance();
+
+    // Size actually allocated for a request: power of two steps split in quarters.
+    static size_t SizeClass(size_t size);
+
+    cl::Buffer Acquire(const cl::Context& context, cl_mem_flags flags, size_t size);
+    void Release(const cl::Buffer& buffer);
+
+    // Frees idle buffers until at most maxBytes are retained. Called with 0 when the
+    // selected device changes.
+    void Trim(size_t maxBytes);
+    // Frees every idle buffer of a context; outstanding ones are forgotten.
+    void Clear(const cl::Context& context);
+
+    Stats GetStats();
+    void ResetCounters();
+
+    // Idle bytes above this are freed on Release instead of being kept. 0 picks
+    // 1/retainDivisor of the global memory of the buffer's device, which phones share with the CPU.
+    size_t maxRetainedBytes = 0;
+    static constexpr size_t retainDivisor = 32;
+
+private:
+    using Key = std::tuple<cl_context, cl_mem_flags, size_t>;
+
+    struct Outstanding {
+        Key key;
+        size_t requested;
+    };
+
+    std::mutex m_mutex;
+    std::map<Key, std::vector<cl::Buffer>> m_free;
+    std::unordered_map<cl_mem, Outstanding> m_outstanding;
+    // automatic retain limit of each context seen by Acquire
+    std::unordered_map<cl_context, size_t> m_retainLimit;
+    Stats m_stats;
+};
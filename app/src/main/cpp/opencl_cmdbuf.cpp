@@ -0,0 +1,121 @@
+#include "opencl_test.h"
+#include "opencl_test_cases.h"
+
+#include <sstream>
+#include <iomanip>
+
+// Command-buffer record/replay.
+// TestCase::Run pays kernel argument setup and a full enqueue for every launch. With
+// cl_khr_command_buffer the same work is recorded once, finalized, and each replay is a
+// single clEnqueueCommandBufferKHR.
+
+std::optional<cl_command_queue_properties> CommandBufferQueueProperties(OpenCLTest* ptr) {
+    auto extensions = ptr->device.getInfo<CL_DEVICE_EXTENSIONS>();
+    if (extensions.find("cl_khr_command_buffer") == std::string::npos)
+        return std::nullopt;
+    return ptr->device.getInfo<CL_DEVICE_COMMAND_BUFFER_REQUIRED_QUEUE_PROPERTIES_KHR>();
+}
+
+// Without simultaneous use a command buffer can't be enqueued again while a replay of it is
+// still pending, so each replay has to wait for the one before.
+static bool SimultaneousUse(OpenCLTest* ptr) {
+    auto caps = ptr->device.getInfo<CL_DEVICE_COMMAND_BUFFER_CAPABILITIES_KHR>();
+    return (caps & CL_COMMAND_BUFFER_CAPABILITY_SIMULTANEOUS_USE_KHR) != 0;
+}
+
+cl::CommandBufferKhr RecordCommandBuffer(TestCase& tc) {
+    auto required = CommandBufferQueueProperties(tc.ptr);
+    if (!required)
+        return {};
+
+    // the recording queue has to carry every property the device asks for
+    auto props = tc.queue.getInfo<CL_QUEUE_PROPERTIES>();
+    if ((props & *required) != *required)
+        return {};
+
+    cl::CommandBufferKhr cmdbuf({ tc.queue }, SimultaneousUse(tc.ptr) ? CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR : 0);
+    if (!tc.Record(cmdbuf))
+        return {};
+    cmdbuf.finalizeCommandBuffer();
+    return cmdbuf;
+}
+
+std::vector<cl::Event> ReplayRun(TestCase& tc, cl::CommandBufferKhr& cmdbuf, int loopCount) {
+    if (!cmdbuf())
+        return tc.Run(loopCount);
+
+    std::vector<cl::Event> events;
+    events.reserve(loopCount);
+    std::vector<cl::CommandQueue> queues = { tc.queue };
+    bool chain = !SimultaneousUse(tc.ptr);
+    std::vector<cl::Event> previous;
+    for (int i = 0; i < loopCount; ++i) {
+        CheckCancelled();
+        cl::Event ev;
+        cmdbuf.enqueueCommandBuffer(queues, chain && !previous.empty() ? &previous : nullptr, &ev);
+        events.push_back(tc.Enqueued(ev));
+        if (chain)
+            previous = { ev };
+    }
+    return events;
+}
+
+template<class T>
+static void CompareReplay(OpenCLTest* ptr, const char* name, int loopCount,
+                          cl_command_queue_properties props, std::stringstream& report) {
+    using clock = std::chrono::high_resolution_clock;
+    try {
+        T tc(ptr, props);
+        tc.Prepare();
+
+        // warm up both paths so neither pays first-launch compilation
+        TimeRun(tc, 1);
+        double plainMs = TimeRun(tc, loopCount);
+
+        auto recordStart = clock::now();
+        auto cmdbuf = RecordCommandBuffer(tc);
+        double recordMs = std::chrono::duration<double, std::milli>(clock::now() - recordStart).count();
+        if (!cmdbuf()) {
+            report << name << "  not recordable, fallback to enqueue\n";
+            return;
+        }
+
+        cl::WaitForEvents(ReplayRun(tc, cmdbuf, 1));
+        auto start = clock::now();
+        cl::WaitForEvents(ReplayRun(tc, cmdbuf, loopCount));
+        double replayMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+        double plainUs = plainMs * 1000.0 / loopCount;
+        double replayUs = replayMs * 1000.0 / loopCount;
+        report << name << "  " << plainUs << "  " << replayUs << "  " << plainUs - replayUs
+               << "  " << recordMs;
+        // a replayed command buffer is exactly where a driver could silently skip work
+        if (!tc.Verify())
+            report << "  invalid";
+        report << "\n";
+    } catch(const cl::Error& e) {
+        std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+        report << name << "  failed: " << msg << "\n";
+    }
+}
+
+std::string RunCommandBufferBenchmark(OpenCLTest* ptr) {
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    auto required = CommandBufferQueueProperties(ptr);
+    if (!required) {
+        report << "cl_khr_command_buffer not supported, tests run with plain enqueue\n";
+        __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+        return report.str();
+    }
+
+    report << "test  enqueue_us  replay_us  saved_us  record_ms  (per launch)\n";
+    CompareReplay<TestLaunchClass>(ptr, "launch", 1000, *required, report);
+    CompareReplay<TestCopyClass>(ptr, "copy", 300, *required, report);
+    CompareReplay<TestFlopsClass>(ptr, "flops", 10, *required, report);
+
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
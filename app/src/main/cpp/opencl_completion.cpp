@@ -0,0 +1,159 @@
+#include "opencl_completion.h"
+#include "opencl_test_cases.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+CompletionLatch::CompletionLatch(): m_start(clock::now()) {}
+
+CompletionLatch::~CompletionLatch() {
+    Wait();
+}
+
+void CompletionLatch::Track(cl::Event ev) {
+    Slot* slot;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_slots.push_back({ this, m_hostMs.size() });
+        slot = &m_slots.back();
+        m_hostMs.push_back(0);
+        m_deviceEnd.push_back(0);
+    }
+    // the runtime keeps the event alive until the callback ran, the caller's copy can go
+    try {
+        ev.setCallback(CL_COMPLETE, OnComplete, slot);
+    } catch(const cl::Error&) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_failed;
+        ++m_completed;
+        throw;
+    }
+}
+
+void CL_CALLBACK CompletionLatch::OnComplete(cl_event ev, cl_int status, void* user) {
+    auto now = clock::now();
+    auto slot = (Slot*)user;
+    auto self = slot->latch;
+
+    // non-blocking query, allowed from a callback
+    cl_ulong end = 0;
+    bool profiled = status == CL_COMPLETE &&
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr) == CL_SUCCESS;
+
+    std::lock_guard<std::mutex> lock(self->m_mutex);
+    self->m_hostMs[slot->index] = std::chrono::duration<double, std::milli>(now - self->m_start).count();
+    self->m_deviceEnd[slot->index] = end;
+    self->m_profiled &= profiled;
+    if (status < 0)
+        ++self->m_failed;
+    if (++self->m_completed == self->m_slots.size())
+        self->m_done.notify_all();
+}
+
+void CompletionLatch::Wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_completed == m_slots.size(); });
+}
+
+std::vector<double> CompletionLatch::HostMs() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hostMs;
+}
+
+std::vector<double> CompletionLatch::DeviceEndMs() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<double> ms;
+    if (!m_profiled || m_deviceEnd.empty())
+        return ms;
+    auto first = *std::min_element(m_deviceEnd.begin(), m_deviceEnd.end());
+    for (auto end : m_deviceEnd)
+        ms.push_back((end - first) / 1000000.0);
+    return ms;
+}
+
+size_t CompletionLatch::Failed() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_failed;
+}
+
+// Gaps between consecutive completions, in microseconds.
+struct IntervalStats {
+    double mean = 0;
+    double stddev = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+static IntervalStats GetIntervalStats(std::vector<double> times) {
+    IntervalStats stats;
+    if (times.size() < 2)
+        return stats;
+    std::sort(times.begin(), times.end());
+    std::vector<double> gaps;
+    for (size_t i = 1; i < times.size(); ++i)
+        gaps.push_back((times[i] - times[i - 1]) * 1000.0);
+
+    for (auto g : gaps)
+        stats.mean += g;
+    stats.mean /= gaps.size();
+    for (auto g : gaps)
+        stats.stddev += (g - stats.mean) * (g - stats.mean);
+    stats.stddev = std::sqrt(stats.stddev / gaps.size());
+
+    std::sort(gaps.begin(), gaps.end());
+    stats.p99 = gaps[std::min(gaps.size() - 1, gaps.size() * 99 / 100)];
+    stats.max = gaps.back();
+    return stats;
+}
+
+template<class T>
+static void CompareCompletion(OpenCLTest* ptr, const char* name, int loopCount, std::stringstream& report) {
+    CheckCancelled();
+    try {
+        double waitMs;
+        {
+            T tc(ptr, CL_QUEUE_PROFILING_ENABLE);
+            tc.Prepare();
+            TimeRun(tc, 1);
+            waitMs = TimeRun(tc, loopCount);
+        }
+
+        CompletionLatch latch;
+        double latchMs = RunTestWithCallbacks<T>(ptr, loopCount, latch);
+        auto host = GetIntervalStats(latch.HostMs());
+        auto device = latch.DeviceEndMs();
+
+        report << name << "  " << waitMs << "  " << latchMs << "  "
+               << host.mean << "  " << host.stddev << "  " << host.p99 << "  " << host.max << "  ";
+        if (device.empty())
+            report << "-";
+        else
+            report << GetIntervalStats(device).stddev;
+        if (latch.Failed())
+            report << "  (" << latch.Failed() << " failed)";
+        report << "\n";
+    } catch(const cl::Error& e) {
+        std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+        report << name << "  failed: " << msg << "\n";
+    }
+}
+
+std::string RunCompletionBenchmark(OpenCLTest* ptr) {
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "test  wait_ms  latch_ms  gap_us  host_jitter_us  p99_us  max_us  dev_jitter_us\n";
+
+    CompareCompletion<TestLaunchClass>(ptr, "launch", 1000, report);
+    ReportProgress(1.0 / 3, report.str());
+    CompareCompletion<TestCopyClass>(ptr, "copy", 100, report);
+    ReportProgress(2.0 / 3, report.str());
+    CompareCompletion<TestFlopsClass>(ptr, "flops", 10, report);
+
+    report << "jitter = stddev of the gap between completions; host minus device jitter is\n"
+              "what callback delivery adds on top of the GPU itself\n";
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
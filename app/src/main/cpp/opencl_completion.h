@@ -0,0 +1,70 @@
+#pragma once
+
+#include "opencl_test.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Completion tracking through clSetEventCallback.
+// RunTest keeps every event alive until one WaitForEvents at the end, which says nothing
+// about when each launch finished. Track() registers a CL_COMPLETE callback instead, so the
+// caller can drop its event right away; the callback stamps the host time of the completion
+// and Wait() returns once every tracked event completed.
+// Callbacks only fire for submitted commands, flush the queues before waiting.
+class CompletionLatch {
+public:
+    using clock = std::chrono::high_resolution_clock;
+
+    CompletionLatch();
+    // waits for outstanding callbacks, they point into this object
+    ~CompletionLatch();
+
+    CompletionLatch(const CompletionLatch&) = delete;
+    CompletionLatch& operator=(const CompletionLatch&) = delete;
+
+    void Track(cl::Event ev);
+    void Wait();
+
+    // Host ms since construction at which each tracked event completed, in Track order.
+    std::vector<double> HostMs();
+    // CL_PROFILING_COMMAND_END of each event in ms relative to the first one, or empty
+    // when the queue had no CL_QUEUE_PROFILING_ENABLE.
+    std::vector<double> DeviceEndMs();
+    // events that terminated with an error status
+    size_t Failed();
+
+private:
+    struct Slot {
+        CompletionLatch* latch;
+        size_t index;
+    };
+
+    static void CL_CALLBACK OnComplete(cl_event ev, cl_int status, void* user);
+
+    clock::time_point m_start;
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    std::deque<Slot> m_slots;   // deque keeps the callbacks' user pointers stable
+    std::vector<double> m_hostMs;
+    std::vector<cl_ulong> m_deviceEnd;
+    size_t m_completed = 0;
+    size_t m_failed = 0;
+    bool m_profiled = true;
+};
+
+// RunTest with completion through a CompletionLatch: every event is handed to the latch
+// right after its enqueue, so early launches can't complete before their callback is set,
+// and released as soon as Run returns. Returns host ms until the latch opened.
+template<class T>
+double RunTestWithCallbacks(OpenCLTest* ptr, int loopCount, CompletionLatch& latch) {
+    T tc(ptr, CL_QUEUE_PROFILING_ENABLE);
+    tc.Prepare();
+
+    tc.onEnqueue = [&](const cl::Event& ev) { latch.Track(ev); };
+    auto start = CompletionLatch::clock::now();
+    tc.Run(loopCount);
+    tc.queue.flush();
+    latch.Wait();
+    return std::chrono::duration<double, std::milli>(CompletionLatch::clock::now() - start).count();
+}
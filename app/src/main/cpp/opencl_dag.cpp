@@ -0,0 +1,181 @@
+#include "opencl_test.h"
+
+#include <sstream>
+#include <iomanip>
+
+// Event DAG throughput.
+// A DAG is `layers` layers of `width` nodes; every node waits on `fanIn` nodes of the
+// previous layer through its event wait list. The same DAG is executed as:
+//   Serial          one in-order queue, no wait lists (the ordering alone is enough)
+//   InOrderWaitList one in-order queue with the wait lists, costs dependency tracking only
+//   OutOfOrder      one CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE queue with the wait lists
+//   MultiQueue      `width` in-order queues, node j of each layer goes to queue j
+// Serial vs InOrderWaitList gives the cost of resolving dependencies, Serial vs the
+// last two gives how much concurrency the driver actually extracts.
+enum class DagMode { Serial, InOrderWaitList, OutOfOrder, MultiQueue };
+
+struct DagShape {
+    int width;
+    int fanIn;
+    int layers;
+};
+
+struct TestDagClass: TestCase {
+    TestDagClass(OpenCLTest* p, DagShape s, DagMode m): TestCase(p), shape(s), mode(m) {}
+
+    // kept small so a single node can't fill the GPU and nodes have room to overlap
+    static constexpr int nodeSize = 16 * 1024;
+    static constexpr int nodeLoops = 256;
+
+    DagShape shape;
+    DagMode mode;
+    cl::Program prg;
+    cl::Kernel kernel;
+    std::vector<cl::Buffer> buffers;
+    std::vector<cl::CommandQueue> queues;
+
+    static constexpr const char* src = R"__(
+kernel void dag_node(global const float* input, global float* output, int loops) {
+    int id = get_global_linear_id();
+    float v = input[id];
+    for (int i = 0; i < loops; ++i)
+        v = mad(v, 0.999f, 0.001f);
+    output[id] = v;
+}
+)__";
+
+    void Prepare() override {
+        prg = BuildProgram(ptr, src);
+        kernel = cl::Kernel(prg, "dag_node");
+
+        buffers.clear();
+        for (int i = 0; i < shape.layers * shape.width; ++i) {
+            buffers.emplace_back(ptr->context, CL_MEM_READ_WRITE, nodeSize * sizeof(cl_float));
+            // 0.0f is also the sentinel: every node moves it away from zero
+            queue.enqueueFillBuffer(buffers.back(), 0.0f, 0, nodeSize * sizeof(cl_float));
+        }
+        queue.finish();
+
+        queues.clear();
+        if (mode == DagMode::OutOfOrder)
+            queues.push_back(ptr->createQueue(CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE));
+        else if (mode == DagMode::MultiQueue)
+            for (int i = 0; i < shape.width; ++i)
+                queues.push_back(ptr->createQueue());
+        else
+            queues.push_back(queue);
+    }
+
+    std::vector<cl::Event> Run(int loopCount) override {
+        std::vector<cl::Event> events;
+        events.reserve(loopCount * shape.layers * shape.width);
+
+        // layer 0 of the next repetition depends on the last layer of the previous one
+        std::vector<cl::Event> prevLayer;
+        for (int it = 0; it < loopCount; ++it) {
+            for (int layer = 0; layer < shape.layers; ++layer) {
+                int inputLayer = layer == 0 ? shape.layers - 1 : layer - 1;
+                std::vector<cl::Event> curLayer(shape.width);
+                for (int j = 0; j < shape.width; ++j) {
+                    CheckCancelled();
+                    std::vector<cl::Event> deps;
+                    if (mode != DagMode::Serial && !prevLayer.empty()) {
+                        for (int k = 0; k < shape.fanIn; ++k)
+                            deps.push_back(prevLayer[(j + k) % shape.width]);
+                    }
+
+                    // enqueue snapshots the arguments, so one kernel object serves every node
+                    kernel.setArg(0, buffers[inputLayer * shape.width + j]);
+                    kernel.setArg(1, buffers[layer * shape.width + j]);
+                    kernel.setArg(2, nodeLoops);
+                    auto& q = queues[j % queues.size()];
+                    q.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(nodeSize), cl::NullRange,
+                                           deps.empty() ? nullptr : &deps, &curLayer[j]);
+                }
+                events.insert(events.end(), curLayer.begin(), curLayer.end());
+                prevLayer = std::move(curLayer);
+            }
+        }
+
+        for (auto& q : queues)
+            q.flush();
+        return events;
+    }
+
+    bool Verify() override {
+        // each node's output is uniform, and the last layer was written by every repetition
+        for (int j = 0; j < shape.width; ++j) {
+            if (DeviceMismatches(*this, buffers[(shape.layers - 1) * shape.width + j], nodeSize, 0, 1))
+                return false;
+        }
+        return true;
+    }
+};
+
+std::string RunDagBenchmark(OpenCLTest* ptr) {
+    static constexpr DagShape shapes[] = {
+        { 1, 1, 32 },   // plain chain
+        { 2, 1, 16 },   // two independent chains
+        { 4, 1, 8 },
+        { 4, 2, 8 },
+        { 4, 4, 8 },    // full barrier between layers
+        { 8, 2, 4 },
+        { 8, 8, 4 },
+    };
+    static constexpr int loopCount = 10;
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    auto hostProps = ptr->device.getInfo<CL_DEVICE_QUEUE_ON_HOST_PROPERTIES>();
+    bool hasOutOfOrder = (hostProps & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+    if (!hasOutOfOrder)
+        report << "out-of-order queue not supported\n";
+
+    report << "WxFxL  serial_ms  dep_us/node  ooo_x  multiq_x\n";
+
+    bool valid = true;
+    auto measure = [&](DagShape shape, DagMode mode) {
+        TestDagClass tc(ptr, shape, mode);
+        tc.Prepare();
+        // warm up
+        TimeRun(tc, 1);
+        double ms = TimeRun(tc, loopCount);
+        valid &= tc.Verify();
+        return ms;
+    };
+
+    int shapeCount = sizeof(shapes) / sizeof(shapes[0]);
+    for (int s = 0; s < shapeCount; ++s) {
+        auto& shape = shapes[s];
+        try {
+            valid = true;
+            int nodes = shape.width * shape.layers * loopCount;
+            double serialMs = measure(shape, DagMode::Serial);
+            double waitListMs = measure(shape, DagMode::InOrderWaitList);
+            double oooMs = hasOutOfOrder ? measure(shape, DagMode::OutOfOrder) : 0;
+            double multiMs = measure(shape, DagMode::MultiQueue);
+
+            report << shape.width << "x" << shape.fanIn << "x" << shape.layers << "  "
+                   << serialMs << "  "
+                   << (waitListMs - serialMs) * 1000.0 / nodes << "  ";
+            if (hasOutOfOrder)
+                report << serialMs / oooMs;
+            else
+                report << "-";
+            report << "  " << serialMs / multiMs;
+            if (!valid)
+                report << "  invalid";
+            report << "\n";
+            ReportProgress((s + 1.0) / shapeCount, report.str());
+        } catch(const cl::Error& e) {
+            std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+            report << shape.width << "x" << shape.fanIn << "x" << shape.layers << "  failed: " << msg << "\n";
+        }
+    }
+
+    report << "x = speedup over serial; >1 means the driver ran nodes concurrently\n";
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
@@ -0,0 +1,159 @@
+#include "opencl_test.h"
+
+#include <sstream>
+#include <iomanip>
+
+// Device fission scaling.
+// Partitions the selected device into 1, 2, 4... sub-devices, runs an equal share of one
+// workload on each partition's queue at the same time and reports how throughput scales.
+// A "1 + rest" by-count split shows what a small isolated partition keeps while the rest
+// of the device is busy, which is the layout for keeping UI-critical compute responsive.
+
+static constexpr const char* fissionSrc = R"__(
+kernel void fission_work(global float* out, int loops) {
+    int id = get_global_id(0);
+    float4 v = (float4)(id * 0.000001f, 1.0f, 2.0f, 3.0f);
+    for (int i = 0; i < loops; ++i)
+        v = mad(v, (float4)(0.999f), (float4)(0.5f));
+    out[id] = v.x + v.y + v.z + v.w;
+}
+)__";
+
+struct Partition {
+    cl::Device device;
+    cl::CommandQueue queue;
+    cl::Kernel kernel;
+    cl::Buffer outBuffer;
+};
+
+static constexpr size_t totalItems = 1024 * 1024;
+static constexpr int loops = 1024;
+
+// Runs `items[i]` work-items on partition i, all partitions at once.
+// Returns host ms until every partition finished, per-partition device ms in `partMs`.
+static double RunPartitions(std::vector<Partition>& parts, const std::vector<size_t>& items,
+                            std::vector<double>& partMs) {
+    using clock = std::chrono::high_resolution_clock;
+    std::vector<cl::Event> events(parts.size());
+    auto start = clock::now();
+    for (size_t i = 0; i < parts.size(); ++i) {
+        parts[i].queue.enqueueNDRangeKernel(parts[i].kernel, cl::NullRange, cl::NDRange(items[i]),
+                                            cl::NullRange, nullptr, &events[i]);
+        parts[i].queue.flush();
+    }
+    cl::WaitForEvents(events);
+    double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+    partMs.clear();
+    for (auto& ev : events)
+        partMs.push_back(ProfiledMs(ev));
+    return ms;
+}
+
+static std::vector<Partition> MakePartitions(const std::vector<cl::Device>& devices) {
+    cl::Context context(devices);
+    cl::Program prg(context, fissionSrc);
+    try {
+        prg.build(devices);
+    } catch(const cl::BuildError& e) {
+        for(auto& x: e.getBuildLog()) {
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", x.second.c_str());
+        }
+        throw;
+    }
+
+    std::vector<Partition> parts;
+    for (auto& device : devices) {
+        Partition part{ device, cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE) };
+        part.kernel = cl::Kernel(prg, "fission_work");
+        part.outBuffer = cl::Buffer(context, CL_MEM_WRITE_ONLY, totalItems * sizeof(cl_float));
+        part.kernel.setArg(0, part.outBuffer);
+        part.kernel.setArg(1, loops);
+        parts.push_back(std::move(part));
+    }
+    return parts;
+}
+
+std::string RunFissionBenchmark(OpenCLTest* ptr) {
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    auto computeUnits = ptr->device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    auto maxSubDevices = ptr->device.getInfo<CL_DEVICE_PARTITION_MAX_SUB_DEVICES>();
+    auto partitionTypes = ptr->device.getInfo<CL_DEVICE_PARTITION_PROPERTIES>();
+    bool equally = false, byCounts = false;
+    for (auto type : partitionTypes) {
+        equally |= type == CL_DEVICE_PARTITION_EQUALLY;
+        byCounts |= type == CL_DEVICE_PARTITION_BY_COUNTS;
+    }
+    report << "compute units " << computeUnits << ", max sub-devices " << maxSubDevices
+           << (equally ? ", equally" : "") << (byCounts ? ", by-counts" : "") << "\n";
+
+    report << "parts  ms  Mitems/s  scaling\n";
+    double baseRate = 0;
+    for (cl_uint n = 1; n <= computeUnits && (n == 1 || n <= maxSubDevices); n *= 2) {
+        CheckCancelled();
+        try {
+            std::vector<cl::Device> devices;
+            if (n == 1) {
+                devices.push_back(ptr->device);
+            } else if (equally) {
+                const cl_device_partition_property props[] = {
+                    CL_DEVICE_PARTITION_EQUALLY, (cl_device_partition_property)(computeUnits / n), 0
+                };
+                ptr->device.createSubDevices(props, &devices);
+            } else {
+                break;
+            }
+
+            auto parts = MakePartitions(devices);
+            std::vector<size_t> items(parts.size(), totalItems / parts.size());
+            std::vector<double> partMs;
+            RunPartitions(parts, items, partMs); // warm up
+            double ms = RunPartitions(parts, items, partMs);
+            double rate = totalItems / ms / 1000.0;
+            if (n == 1)
+                baseRate = rate;
+            report << parts.size() << "  " << ms << "  " << rate << "  " << rate / baseRate << "x\n";
+        } catch(const cl::Error& e) {
+            std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+            report << n << "  failed: " << msg << "\n";
+            break;
+        }
+    }
+
+    if (byCounts && computeUnits >= 2) {
+        CheckCancelled();
+        try {
+            const cl_device_partition_property props[] = {
+                CL_DEVICE_PARTITION_BY_COUNTS, 1, (cl_device_partition_property)(computeUnits - 1),
+                CL_DEVICE_PARTITION_BY_COUNTS_LIST_END, 0
+            };
+            std::vector<cl::Device> devices;
+            ptr->device.createSubDevices(props, &devices);
+            auto parts = MakePartitions(devices);
+
+            // the small partition gets a UI-sized job while the big one is loaded
+            std::vector<size_t> items = { totalItems / computeUnits, totalItems };
+            std::vector<double> partMs;
+            RunPartitions(parts, items, partMs);
+            RunPartitions(parts, items, partMs);
+            std::vector<double> aloneMs;
+            std::vector<Partition> small(parts.begin(), parts.begin() + 1);
+            RunPartitions(small, { items[0] }, aloneMs);
+            report << "1+" << computeUnits - 1 << " split: isolated part " << partMs[0]
+                   << " ms loaded / " << aloneMs[0] << " ms alone, big part " << partMs[1] << " ms\n";
+        } catch(const cl::Error& e) {
+            std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+            report << "by-counts failed: " << msg << "\n";
+        }
+    }
+
+    if (!equally && !byCounts)
+        report << "device can't be partitioned\n";
+
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
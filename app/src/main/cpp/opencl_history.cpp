@@ -0,0 +1,328 @@
+#include <jni.h>
+#include "opencl_history.h"
+#include "build_hash.h"   // generated, see build_hash.cmake
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <unistd.h>
+
+static constexpr char storeMagic[4] = { 'S', 'R', 'Y', 'H' };
+static constexpr uint32_t storeVersion = 1;
+
+const char* BuildHash() {
+#ifdef FEATURETEST_BUILD_HASH
+    return FEATURETEST_BUILD_HASH;
+#else
+    return "unknown";
+#endif
+}
+
+ResultStore& ResultStore::Instance() {
+    static ResultStore store;
+    return store;
+}
+
+// Reads from a record body, failing instead of running past its end.
+struct RecordReader {
+    const char* pos;
+    const char* end;
+
+    template<class T>
+    bool Get(T& value) {
+        if (end - pos < (ptrdiff_t)sizeof(T))
+            return false;
+        memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    bool GetString(std::string& str) {
+        uint16_t len;
+        if (!Get(len) || end - pos < len)
+            return false;
+        str.assign(pos, len);
+        pos += len;
+        return true;
+    }
+};
+
+static bool ParseRecord(const std::vector<char>& body, ResultRecord& record) {
+    RecordReader reader{ body.data(), body.data() + body.size() };
+    uint8_t valid;
+    if (!reader.Get(record.timeMs) || !reader.Get(record.value) || !reader.Get(valid) ||
+        !reader.GetString(record.key.device) || !reader.GetString(record.key.driver) ||
+        !reader.GetString(record.key.build) || !reader.GetString(record.key.test))
+        return false;
+    record.valid = valid != 0;
+    return true;
+}
+
+// Reads the record at the current position of a file `fileSize` bytes long; false at the
+// end of the file and on a torn or corrupt record.
+static bool ReadRecord(FILE* file, long fileSize, std::vector<char>& body, ResultRecord& record) {
+    uint32_t size;
+    if (fread(&size, sizeof(size), 1, file) != 1)
+        return false;
+    // a torn size field can claim gigabytes
+    if (size > (unsigned long)(fileSize - ftell(file)))
+        return false;
+    body.resize(size);
+    if (fread(body.data(), 1, size, file) != size)
+        return false;
+    return ParseRecord(body, record);
+}
+
+bool ResultStore::Open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_path.clear();
+
+    std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(path.c_str(), "a+b"), fclose);
+    if (!file)
+        return false;
+
+    fseek(file.get(), 0, SEEK_END);
+    if (ftell(file.get()) == 0) {
+        fwrite(storeMagic, sizeof(storeMagic), 1, file.get());
+        fwrite(&storeVersion, sizeof(storeVersion), 1, file.get());
+    } else {
+        char magic[4];
+        uint32_t version = 0;
+        fseek(file.get(), 0, SEEK_SET);
+        if (fread(magic, sizeof(magic), 1, file.get()) != 1 || memcmp(magic, storeMagic, sizeof(magic)) != 0 ||
+            fread(&version, sizeof(version), 1, file.get()) != 1 || version != storeVersion) {
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", ("not a result store: " + path).c_str());
+            return false;
+        }
+
+        // appends after a torn record would be unreachable for Load
+        fseek(file.get(), 0, SEEK_END);
+        long fileSize = ftell(file.get());
+        fseek(file.get(), sizeof(storeMagic) + sizeof(storeVersion), SEEK_SET);
+        long complete = ftell(file.get());
+        std::vector<char> body;
+        ResultRecord record;
+        while (ReadRecord(file.get(), fileSize, body, record))
+            complete = ftell(file.get());
+        if (complete < fileSize) {
+            std::string msg = "result store: dropping " + std::to_string(fileSize - complete) +
+                              " bytes of a torn record at the end of " + path;
+            __android_log_write(ANDROID_LOG_WARN, "SORAYUKI", msg.c_str());
+            fflush(file.get());
+            if (ftruncate(fileno(file.get()), complete) != 0) {
+                __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", ("can't truncate " + path).c_str());
+                return false;
+            }
+        }
+    }
+    m_path = path;
+    return true;
+}
+
+bool ResultStore::IsOpen() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_path.empty();
+}
+
+template<class T>
+static void Put(std::string& out, const T& value) {
+    out.append((const char*)&value, sizeof(value));
+}
+
+static void PutString(std::string& out, const std::string& str) {
+    uint16_t len = (uint16_t)std::min<size_t>(str.size(), UINT16_MAX);
+    Put(out, len);
+    out.append(str, 0, len);
+}
+
+bool ResultStore::Append(const ResultRecord& record) {
+    std::string body;
+    Put(body, record.timeMs);
+    Put(body, record.value);
+    Put(body, (uint8_t)(record.valid ? 1 : 0));
+    PutString(body, record.key.device);
+    PutString(body, record.key.driver);
+    PutString(body, record.key.build);
+    PutString(body, record.key.test);
+
+    std::string bytes;
+    Put(bytes, (uint32_t)body.size());
+    bytes += body;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_path.empty())
+        return false;
+    std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(m_path.c_str(), "ab"), fclose);
+    if (!file)
+        return false;
+    return fwrite(bytes.data(), bytes.size(), 1, file.get()) == 1;
+}
+
+std::vector<ResultRecord> ResultStore::Load() {
+    std::vector<ResultRecord> records;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_path.empty())
+        return records;
+    std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(m_path.c_str(), "rb"), fclose);
+    if (!file)
+        return records;
+
+    fseek(file.get(), 0, SEEK_END);
+    long fileSize = ftell(file.get());
+    fseek(file.get(), sizeof(storeMagic) + sizeof(storeVersion), SEEK_SET);
+    std::vector<char> body;
+    ResultRecord record;
+    while (ReadRecord(file.get(), fileSize, body, record))
+        records.push_back(std::move(record));
+    return records;
+}
+
+void RecordResult(OpenCLTest* ptr, const std::string& test, double value) {
+    auto& store = ResultStore::Instance();
+    if (!store.IsOpen())
+        return;
+
+    ResultRecord record;
+    record.timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    record.value = value;
+    record.valid = !std::isnan(value);
+    record.key.device = ptr->device.getInfo<CL_DEVICE_NAME>();
+    record.key.driver = ptr->device.getInfo<CL_DRIVER_VERSION>();
+    record.key.build = BuildHash();
+    record.key.test = test;
+    if (!store.Append(record))
+        __android_log_write(ANDROID_LOG_WARN, "SORAYUKI", "failed to append benchmark result");
+}
+
+// Results of one device and test under one driver and build.
+struct Sample {
+    std::string driver;
+    std::string build;
+    std::vector<double> values;
+    int64_t lastTimeMs = 0;
+
+    double Mean() const {
+        double sum = 0;
+        for (auto v : values)
+            sum += v;
+        return sum / values.size();
+    }
+
+    double Variance() const {
+        double mean = Mean(), sum = 0;
+        for (auto v : values)
+            sum += (v - mean) * (v - mean);
+        return sum / (values.size() - 1);
+    }
+};
+
+// Two-sided 95% critical value of Student's t.
+static double CriticalT(double df) {
+    static constexpr double table[] = {
+        12.71, 4.30, 3.18, 2.78, 2.57, 2.45, 2.36, 2.31, 2.26, 2.23,
+        2.20, 2.18, 2.16, 2.14, 2.13, 2.12, 2.11, 2.10, 2.09, 2.09,
+    };
+    int i = (int)std::floor(df);
+    if (i < 1)
+        return table[0];
+    if (i <= 20)
+        return table[i - 1];
+    return df < 30 ? 2.06 : 1.96;
+}
+
+// Every device and test is compared between its latest driver/build configuration and
+// the configuration measured before it, with Welch's t-test on the valid results.
+std::string RunHistoryReport(OpenCLTest* ptr) {
+    // changes smaller than this are noise even when statistically significant
+    static constexpr double minChange = 0.02;
+    static constexpr size_t minSamples = 3;
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    auto& store = ResultStore::Instance();
+    if (!store.IsOpen()) {
+        report << "result store not open\n";
+        return report.str();
+    }
+    auto records = store.Load();
+    report << records.size() << " results, build " << BuildHash() << "\n";
+
+    // per device and test, the configurations in the order they were first seen
+    std::map<std::pair<std::string, std::string>, std::vector<Sample>> series;
+    for (auto& record : records) {
+        if (!record.valid)
+            continue;
+        auto& samples = series[{ record.key.device, record.key.test }];
+        if (samples.empty() || samples.back().driver != record.key.driver || samples.back().build != record.key.build)
+            samples.push_back({ record.key.driver, record.key.build });
+        samples.back().values.push_back(record.value);
+        samples.back().lastTimeMs = record.timeMs;
+    }
+
+    report << "device / test  baseline  current  change  verdict\n";
+    for (auto& [key, samples] : series) {
+        report << key.first << " / " << key.second << "  ";
+        if (samples.size() < 2) {
+            report << "no baseline (" << samples.back().values.size() << " runs)\n";
+            continue;
+        }
+        auto& base = samples[samples.size() - 2];
+        auto& cur = samples.back();
+        if (base.values.size() < minSamples || cur.values.size() < minSamples) {
+            report << "need " << minSamples << " runs per configuration (have "
+                   << base.values.size() << " / " << cur.values.size() << ")\n";
+            continue;
+        }
+
+        double baseMean = base.Mean(), curMean = cur.Mean();
+        double baseVar = base.Variance() / base.values.size();
+        double curVar = cur.Variance() / cur.values.size();
+        double change = (curMean - baseMean) / baseMean;
+        report << baseMean << "  " << curMean << "  " << change * 100.0 << "%  ";
+
+        bool significant;
+        if (baseVar + curVar <= 0) {
+            significant = curMean != baseMean;
+        } else {
+            double t = (curMean - baseMean) / std::sqrt(baseVar + curVar);
+            double df = (baseVar + curVar) * (baseVar + curVar) /
+                (baseVar * baseVar / (base.values.size() - 1) + curVar * curVar / (cur.values.size() - 1));
+            significant = std::fabs(t) > CriticalT(df);
+        }
+        // every benchmark reports throughput, so higher is better
+        if (!significant || std::fabs(change) < minChange)
+            report << "unchanged";
+        else if (change < 0)
+            report << "REGRESSION";
+        else
+            report << "improvement";
+        if (base.driver != cur.driver)
+            report << " (driver " << base.driver << " -> " << cur.driver << ")";
+        if (base.build != cur.build)
+            report << " (build " << base.build << " -> " << cur.build << ")";
+        report << "\n";
+    }
+
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_net_sorayuki_featuretest_OpenCLTest_OpenHistory
+(JNIEnv *env, jobject thiz, jstring path) {
+    jboolean isCopy = JNI_FALSE;
+    auto strPath = env->GetStringUTFChars(path, &isCopy);
+    std::shared_ptr<int> guard{(int*)1024, [=](int*){
+        if (isCopy == JNI_TRUE)
+            env->ReleaseStringUTFChars(path, strPath);
+    }};
+
+    return ResultStore::Instance().Open(strPath);
+}
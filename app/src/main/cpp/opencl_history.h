@@ -0,0 +1,52 @@
+#pragma once
+
+#include "opencl_test.h"
+
+#include <cstdint>
+#include <mutex>
+
+// Append-only store of benchmark results.
+// File layout: "SRYH", uint32 version, then one record after another:
+//   uint32 size of the rest of the record
+//   int64  unix time in ms
+//   double value
+//   uint8  valid (0 when verification failed)
+//   device, driver, build, test: each uint16 length + UTF-8 bytes
+// A record is written with a single fwrite, so a crash can only leave a truncated tail.
+// Open() cuts such a tail off, so records appended later are not lost behind it.
+
+struct ResultKey {
+    std::string device;   // CL_DEVICE_NAME
+    std::string driver;   // CL_DRIVER_VERSION
+    std::string build;    // BuildHash() of the app that measured
+    std::string test;     // test name and configuration, e.g. "copy loops=300"
+};
+
+struct ResultRecord {
+    int64_t timeMs = 0;
+    double value = 0;
+    bool valid = true;
+    ResultKey key;
+};
+
+class ResultStore {
+public:
+    static ResultStore& Instance();
+
+    // Creates the file if needed; false if it can't be written or isn't a store.
+    bool Open(const std::string& path);
+    bool IsOpen();
+
+    bool Append(const ResultRecord& record);
+    std::vector<ResultRecord> Load();
+
+private:
+    std::mutex m_mutex;
+    std::string m_path;
+};
+
+// Git revision the native library was built from, "unknown" outside a git checkout.
+const char* BuildHash();
+
+// Appends one result of the selected device to the store, if it is open.
+void RecordResult(OpenCLTest* ptr, const std::string& test, double value);
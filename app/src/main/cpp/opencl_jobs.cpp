@@ -0,0 +1,162 @@
+#include <jni.h>
+#include "opencl_test.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Native job runner.
+// TestCompute/TestReport block the calling Java thread until the run is over. A job runs the
+// same benchmark on its own native thread instead, reports progress and partial results to
+// a Java listener, and can be cancelled; benchmarks check for that between enqueues.
+
+struct Job {
+    jlong handle;
+    OpenCLTest* ptr;
+    // devices and selection of ptr when the job started; the job selects on this copy
+    OpenCLTest state;
+    std::string type;
+    std::atomic<bool> cancelled{ false };
+    std::atomic<bool> finished{ false };
+    std::thread thread;
+
+    JavaVM* vm = nullptr;
+    jobject listener = nullptr;   // global ref
+    jmethodID onProgress = nullptr;
+    jmethodID onFinished = nullptr;
+    JNIEnv* env = nullptr;        // of the worker thread, valid while it runs
+};
+
+static std::mutex g_jobsMutex;
+static std::map<jlong, std::shared_ptr<Job>> g_jobs;
+static jlong g_nextHandle = 1;
+static thread_local Job* t_currentJob = nullptr;
+
+void CheckCancelled() {
+    if (t_currentJob && t_currentJob->cancelled.load(std::memory_order_relaxed))
+        throw JobCancelled();
+}
+
+void ReportProgress(double fraction, const std::string& partial) {
+    auto job = t_currentJob;
+    if (!job || !job->listener)
+        return;
+    auto str = job->env->NewStringUTF(partial.c_str());
+    job->env->CallVoidMethod(job->listener, job->onProgress, job->handle, (jdouble)fraction, str);
+    if (job->env->ExceptionCheck())
+        job->env->ExceptionClear();
+    job->env->DeleteLocalRef(str);
+}
+
+static void RunJob(Job* job) {
+    JNIEnv* env = nullptr;
+    job->vm->AttachCurrentThread(&env, nullptr);
+    job->env = env;
+    t_currentJob = job;
+
+    std::string result;
+    bool cancelled = false;
+    try {
+        if (job->type == "copy" || job->type == "flops")
+            result = std::to_string(RunComputeTest(&job->state, job->type.c_str()));
+        else
+            result = RunReportTest(&job->state, job->type.c_str());
+    } catch(const JobCancelled&) {
+        cancelled = true;
+    } catch(const cl::Error& e) {
+        result = "[" + std::to_string(e.err()) + "]" + e.what();
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", result.c_str());
+    } catch(const std::exception& e) {
+        // e.g. bad_alloc or system_error from a helper thread; leaving the thread would terminate
+        result = e.what();
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", result.c_str());
+    }
+
+    auto str = env->NewStringUTF(result.c_str());
+    env->CallVoidMethod(job->listener, job->onFinished, job->handle, str, (jboolean)cancelled);
+    if (env->ExceptionCheck())
+        env->ExceptionClear();
+    env->DeleteLocalRef(str);
+    env->DeleteGlobalRef(job->listener);
+    job->listener = nullptr;
+
+    t_currentJob = nullptr;
+    job->env = nullptr;
+    job->finished = true;
+    job->vm->DetachCurrentThread();
+}
+
+// Joins jobs whose thread already returned. Caller holds g_jobsMutex.
+static void ReapFinishedJobs() {
+    for (auto it = g_jobs.begin(); it != g_jobs.end();) {
+        if (it->second->finished) {
+            it->second->thread.join();
+            it = g_jobs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Cancels and waits for every job of an OpenCLTest, before it is deleted.
+void StopJobs(OpenCLTest* ptr) {
+    std::vector<std::shared_ptr<Job>> stopping;
+    {
+        std::lock_guard<std::mutex> lock(g_jobsMutex);
+        for (auto it = g_jobs.begin(); it != g_jobs.end();) {
+            if (it->second->ptr == ptr) {
+                it->second->cancelled = true;
+                stopping.push_back(it->second);
+                it = g_jobs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (auto& job : stopping)
+        job->thread.join();
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_net_sorayuki_featuretest_OpenCLTest_StartJob
+(JNIEnv *env, jobject thiz, jlong self, jstring type, jobject listener) {
+    jboolean isCopy = JNI_FALSE;
+    auto strTestType = env->GetStringUTFChars(type, &isCopy);
+    std::shared_ptr<int> guard{(int*)1024, [=](int*){
+        if (isCopy == JNI_TRUE)
+            env->ReleaseStringUTFChars(type, strTestType);
+    }};
+
+    auto job = std::make_shared<Job>();
+    job->ptr = (OpenCLTest*)self;
+    job->type = strTestType;
+    {
+        std::lock_guard<std::mutex> lock(job->ptr->mutex);
+        job->state.devices = job->ptr->devices;
+        job->state.Select(job->ptr->selected);
+    }
+    env->GetJavaVM(&job->vm);
+    job->listener = env->NewGlobalRef(listener);
+    auto cls = env->GetObjectClass(listener);
+    job->onProgress = env->GetMethodID(cls, "onJobProgress", "(JDLjava/lang/String;)V");
+    job->onFinished = env->GetMethodID(cls, "onJobFinished", "(JLjava/lang/String;Z)V");
+    env->DeleteLocalRef(cls);
+
+    std::lock_guard<std::mutex> lock(g_jobsMutex);
+    ReapFinishedJobs();
+    job->handle = g_nextHandle++;
+    g_jobs[job->handle] = job;
+    job->thread = std::thread(RunJob, job.get());
+    return job->handle;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_net_sorayuki_featuretest_OpenCLTest_CancelJob
+(JNIEnv *env, jobject thiz, jlong handle) {
+    std::lock_guard<std::mutex> lock(g_jobsMutex);
+    auto it = g_jobs.find(handle);
+    if (it != g_jobs.end())
+        it->second->cancelled = true;
+}
@@ -0,0 +1,192 @@
+#include "opencl_test.h"
+#include "opencl_buffer_pool.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+
+// Per-device suite runs and a combined mode that splits one workload over every device.
+
+// Device indices in `subset`, or nullopt when an item isn't a valid index.
+static std::optional<std::vector<int>> ParseSubset(OpenCLTest* ptr, const std::string& subset) {
+    std::vector<int> indices;
+    if (subset.empty()) {
+        for (int i = 0; i < (int)ptr->devices.size(); ++i)
+            indices.push_back(i);
+        return indices;
+    }
+    std::stringstream ss(subset);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        char* end = nullptr;
+        errno = 0;
+        long index = strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || errno == ERANGE || index < 0 || index >= (long)ptr->devices.size()) {
+            std::string msg = "invalid device index: \"" + item + "\"";
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+            return std::nullopt;
+        }
+        indices.push_back((int)index);
+    }
+    return indices;
+}
+
+std::string RunDeviceSuite(OpenCLTest* ptr, const std::string& subset) {
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "#  device  copy_MB/s  GFLOPS\n";
+
+    auto parsed = ParseSubset(ptr, subset);
+    if (!parsed)
+        return "invalid device subset: " + subset + "\n";
+    auto& indices = *parsed;
+
+    int previous = ptr->selected;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        int index = indices[i];
+        ptr->Select(index);
+        report << index << "  " << ptr->device.getInfo<CL_DEVICE_NAME>();
+        try {
+            double copy = RunComputeTest(ptr, "copy");
+            double flops = RunComputeTest(ptr, "flops");
+            if (std::isnan(copy) || std::isnan(flops))
+                report << "  invalid\n";
+            else
+                report << "  " << copy << "  " << flops / 1000000000.0 << "\n";
+            ReportProgress((i + 1.0) / indices.size(), report.str());
+            // the next device has its own context, this one's buffers would only pile up
+            BufferPool::Instance().Trim(0);
+        } catch(const cl::Error& e) {
+            std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+            report << "  failed: " << msg << "\n";
+        } catch(const JobCancelled&) {
+            ptr->Select(previous);
+            throw;
+        }
+    }
+    ptr->Select(previous);
+
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
+
+// One share of the split workload on one device.
+struct SplitPart {
+    DeviceEntry* entry;
+    cl::CommandQueue queue;
+    cl::Kernel kernel;
+    cl::Buffer outBuffer;
+    double itemsPerMs = 0;
+    size_t offset = 0;
+    size_t count = 0;
+};
+
+static constexpr const char* splitSrc = R"__(
+kernel void split_work(global float* out, int loops) {
+    int id = get_global_id(0);
+    float4 v = (float4)(id * 0.000001f, 1.0f, 2.0f, 3.0f);
+    for (int i = 0; i < loops; ++i)
+        v = mad(v, (float4)(0.999f), (float4)(0.5f));
+    out[id - get_global_offset(0)] = v.x + v.y + v.z + v.w;
+}
+)__";
+
+std::string RunSplitBenchmark(OpenCLTest* ptr) {
+    static constexpr size_t totalItems = 4 * 1024 * 1024;
+    static constexpr size_t probeItems = totalItems / 16;
+    static constexpr int loops = 2048;
+    // split sizes are rounded to this so every device gets whole work-groups
+    static constexpr size_t granularity = 256;
+    using clock = std::chrono::high_resolution_clock;
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    std::vector<SplitPart> parts;
+    for (auto& entry : ptr->devices) {
+        CheckCancelled();
+        try {
+            OpenCLTest single;
+            single.devices.push_back(entry);
+            single.Select(0);
+
+            SplitPart part{ &entry, single.createQueue() };
+            part.kernel = cl::Kernel(BuildProgram(&single, splitSrc), "split_work");
+            part.outBuffer = cl::Buffer(entry.context, CL_MEM_WRITE_ONLY, totalItems * sizeof(cl_float));
+            part.kernel.setArg(0, part.outBuffer);
+            part.kernel.setArg(1, loops);
+
+            // warm up, then probe the throughput alone
+            part.queue.enqueueNDRangeKernel(part.kernel, cl::NullRange, cl::NDRange(granularity));
+            part.queue.finish();
+            auto start = clock::now();
+            part.queue.enqueueNDRangeKernel(part.kernel, cl::NullRange, cl::NDRange(probeItems));
+            part.queue.finish();
+            double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+            part.itemsPerMs = probeItems / ms;
+            report << entry.device.getInfo<CL_DEVICE_NAME>() << ": " << part.itemsPerMs / 1000.0 << " Mitems/s\n";
+            parts.push_back(std::move(part));
+        } catch(const cl::Error& e) {
+            std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+            report << entry.device.getInfo<CL_DEVICE_NAME>() << ": failed " << msg << "\n";
+        }
+    }
+    if (parts.empty()) {
+        report << "no usable device\n";
+        return report.str();
+    }
+
+    // shares proportional to the measured throughput, the last device takes the remainder
+    double totalRate = 0;
+    for (auto& part : parts)
+        totalRate += part.itemsPerMs;
+    size_t assigned = 0;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        auto& part = parts[i];
+        part.offset = assigned;
+        if (i + 1 == parts.size()) {
+            part.count = totalItems - assigned;
+        } else {
+            part.count = (size_t)(totalItems * part.itemsPerMs / totalRate) / granularity * granularity;
+        }
+        assigned += part.count;
+    }
+
+    CheckCancelled();
+    try {
+        auto best = std::max_element(parts.begin(), parts.end(),
+            [](const SplitPart& a, const SplitPart& b) { return a.itemsPerMs < b.itemsPerMs; });
+        auto start = clock::now();
+        best->queue.enqueueNDRangeKernel(best->kernel, cl::NullRange, cl::NDRange(totalItems));
+        best->queue.finish();
+        double singleMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+        start = clock::now();
+        for (auto& part : parts) {
+            if (part.count)
+                part.queue.enqueueNDRangeKernel(part.kernel, cl::NDRange(part.offset), cl::NDRange(part.count));
+            part.queue.flush();
+        }
+        for (auto& part : parts)
+            part.queue.finish();
+        double combinedMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+        for (auto& part : parts)
+            report << part.entry->device.getInfo<CL_DEVICE_NAME>() << ": share "
+                   << 100.0 * part.count / totalItems << "%\n";
+        report << "best single device " << singleMs << " ms, combined " << combinedMs
+               << " ms, speedup " << singleMs / combinedMs << "x\n";
+    } catch(const cl::Error& e) {
+        std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+        report << "failed: " << msg << "\n";
+    }
+
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
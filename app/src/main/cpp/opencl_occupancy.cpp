@@ -0,0 +1,151 @@
+#include "opencl_test.h"
+
+#include <sstream>
+#include <iomanip>
+
+// Register pressure sweep.
+// TestFlopsClass keeps a fixed set of accumulators, so it only shows one occupancy point.
+// Here the kernel is generated with N independent float4 accumulators that all stay live
+// across the loop; more accumulators means more ILP per work-item but fewer resident
+// work-items per core, until the compiler runs out of registers and starts spilling.
+struct TestOccupancyClass: TestCase {
+    TestOccupancyClass(OpenCLTest* p, int acc)
+        : TestCase(p, CL_QUEUE_PROFILING_ENABLE), accumulators(acc) {}
+
+    static constexpr int globalSize = 1024 * 1024;
+    // every level does the same amount of math per work-item
+    static constexpr int madsPerWorkItem = 64 * 1024;
+
+    int accumulators;
+    cl::Program prg;
+    cl::Kernel kernel;
+    cl::Buffer outBuffer;
+
+    int innerLoop() const { return madsPerWorkItem / accumulators; }
+
+    std::string GenerateSource() const {
+        std::stringstream src;
+        src << "kernel void reg_sweep(global float* outbuf, int loops, float seed) {\n";
+        src << "    int id = get_global_linear_id();\n";
+        src << "    float4 x = (float4)(seed + id * 0.000001f);\n";
+        src << "    float4 y = (float4)(0.5f);\n";
+        for (int i = 0; i < accumulators; ++i)
+            src << "    float4 acc" << i << " = x + (float4)(" << i << ".0f);\n";
+        src << "    for (int i = 0; i < loops; ++i) {\n";
+        for (int i = 0; i < accumulators; ++i)
+            src << "        acc" << i << " = mad(acc" << i << ", x, y);\n";
+        src << "    }\n";
+        src << "    float4 total = (float4)(0.0f);\n";
+        for (int i = 0; i < accumulators; ++i)
+            src << "    total += acc" << i << ";\n";
+        src << "    outbuf[id] = total.x + total.y + total.z + total.w;\n";
+        src << "}\n";
+        return src.str();
+    }
+
+    void Prepare() override {
+        outBuffer = cl::Buffer(ptr->context, CL_MEM_READ_WRITE, globalSize * sizeof(cl_float));
+        queue.enqueueFillBuffer(outBuffer, verifySentinel, 0, globalSize * sizeof(cl_float));
+        queue.finish();
+        prg = BuildProgram(ptr, GenerateSource());
+        kernel = cl::Kernel(prg, "reg_sweep");
+    }
+
+    std::vector<cl::Event> Run(int loopCount) override {
+        std::vector<cl::Event> events;
+        events.reserve(loopCount);
+        cl::KernelFunctor<cl::Buffer, int, float> reg_sweep(kernel);
+
+        for (int it = 0; it < loopCount; ++it) {
+            CheckCancelled();
+            events.push_back(reg_sweep(cl::EnqueueArgs(queue, cl::NDRange(globalSize)), outBuffer, innerLoop(), 0.999f));
+        }
+        return events;
+    }
+
+    bool Verify() override {
+        // outputs differ per work-item and may overflow, only check that all were written
+        return DeviceMismatches(*this, outBuffer, globalSize, verifySentinel) == 0;
+    }
+
+    double FlopsPerKernel() const {
+        // each float4 mad counts as 8 ops
+        return 8.0 * innerLoop() * accumulators * (double)globalSize;
+    }
+};
+
+std::string RunOccupancySweep(OpenCLTest* ptr) {
+    // float4 accumulators, i.e. 4 scalar registers each
+    static constexpr int levels[] = { 1, 2, 4, 8, 16, 24, 32, 48, 64, 96, 128 };
+    static constexpr int loopCount = 5;
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "regs  wg_max  private_B  GFLOPS\n";
+
+    double peak = 0;
+    int budget = 0;
+    bool collapsed = false;
+    size_t baseWorkGroup = 0;
+    cl_ulong basePrivate = 0;
+
+    int levelCount = sizeof(levels) / sizeof(levels[0]);
+    for (int level = 0; level < levelCount; ++level) {
+        int acc = levels[level];
+        int regs = acc * 4;
+        try {
+            TestOccupancyClass tc(ptr, acc);
+            tc.Prepare();
+
+            auto wgSize = tc.kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(ptr->device);
+            auto privateSize = tc.kernel.getWorkGroupInfo<CL_KERNEL_PRIVATE_MEM_SIZE>(ptr->device);
+            if (baseWorkGroup == 0) {
+                baseWorkGroup = wgSize;
+                basePrivate = privateSize;
+            }
+
+            // warm up, the first launch may include lazy compilation
+            cl::WaitForEvents(tc.Run(1));
+            auto events = tc.Run(loopCount);
+            cl::WaitForEvents(events);
+
+            double totalMs = 0;
+            for (auto& ev : events)
+                totalMs += ProfiledMs(ev);
+            double gflops = totalMs > 0 ? tc.FlopsPerKernel() * loopCount / (totalMs * 1000000.0) : 0;
+
+            report << regs << "  " << wgSize << "  " << privateSize << "  " << gflops;
+            // private memory growing beyond the baseline means the compiler spilled accumulators
+            if (privateSize > basePrivate)
+                report << "  spill";
+            // the driver shrinks the max work-group when one work-item needs too many registers
+            if (wgSize < baseWorkGroup)
+                report << "  occupancy-limited";
+            bool valid = tc.Verify();
+            if (!valid) {
+                report << "  invalid";
+            } else if (peak > 0 && gflops < peak * 0.5) {
+                report << "  collapse";
+                collapsed = true;
+            }
+            report << "\n";
+            ReportProgress((level + 1.0) / levelCount, report.str());
+            if (!valid)
+                continue;
+
+            if (gflops > peak)
+                peak = gflops;
+            if (!collapsed)
+                budget = regs;
+        } catch(const cl::Error& e) {
+            std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+            report << regs << "  failed: " << msg << "\n";
+            break;
+        }
+    }
+
+    report << "register budget before collapse: " << budget << " scalar regs/work-item\n";
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
@@ -0,0 +1,143 @@
+#include "opencl_test.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+// Queue-depth saturation.
+// Enqueues launches back to back without ever waiting and times every enqueue call on the
+// host. While the driver has room the call only appends to a software queue; once that is
+// full it blocks until the GPU retires work, which shows up as a jump in enqueue latency.
+// The depth where that happens is how far a producer thread can run ahead of the GPU.
+
+struct TestQueueDepthClass: TestCase {
+    using TestCase::TestCase;
+
+    // long enough per launch that the GPU can't drain the queue as fast as the host fills it
+    static constexpr int globalSize = 64 * 1024;
+    static constexpr int loops = 512;
+
+    cl::Buffer buffer;
+    cl::Program prg;
+    cl::Kernel kernel;
+    // host microseconds of each enqueue call of the last Run
+    std::vector<double> enqueueUs;
+
+    static constexpr const char* src = R"__(
+        kernel void depth_work(global float* data, int loops) {
+            int gid = get_global_id(0);
+            float v = data[gid];
+            for (int i = 0; i < loops; ++i)
+                v = mad(v, 0.999f, 0.001f);
+            data[gid] = v;
+        }
+    )__";
+
+    void Prepare() override {
+        buffer = AcquireBuffer(CL_MEM_READ_WRITE, globalSize * sizeof(cl_float));
+        queue.enqueueFillBuffer(buffer, 0.0f, 0, globalSize * sizeof(cl_float));
+        queue.finish();
+        prg = BuildProgram(ptr, src);
+        kernel = cl::Kernel(prg, "depth_work");
+        kernel.setArg(0, buffer);
+        kernel.setArg(1, loops);
+    }
+
+    std::vector<cl::Event> Run(int loopCount) override {
+        using clock = std::chrono::high_resolution_clock;
+        std::vector<cl::Event> events(loopCount);
+        enqueueUs.clear();
+        enqueueUs.reserve(loopCount);
+        for (int i = 0; i < loopCount; ++i) {
+            CheckCancelled();
+            auto start = clock::now();
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(globalSize), cl::NullRange,
+                                       nullptr, &events[i]);
+            enqueueUs.push_back(std::chrono::duration<double, std::micro>(clock::now() - start).count());
+        }
+        queue.flush();
+        return events;
+    }
+
+    bool Verify() override {
+        return DeviceMismatches(*this, buffer, globalSize, 0, 1) == 0;
+    }
+};
+
+static double Median(std::vector<double> values) {
+    if (values.empty())
+        return 0;
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+// First depth whose trailing window median is well above the shallow-queue baseline, or 0.
+static int BackPressureDepth(const std::vector<double>& us) {
+    static constexpr size_t baselineCount = 32;
+    static constexpr size_t window = 16;
+    if (us.size() < baselineCount + window)
+        return 0;
+    double baseline = Median(std::vector<double>(us.begin(), us.begin() + baselineCount));
+    // the absolute floor keeps a very fast driver from tripping on scheduler noise
+    double threshold = std::max(baseline * 4.0, baseline + 50.0);
+    for (size_t i = baselineCount; i + window <= us.size(); ++i) {
+        if (Median(std::vector<double>(us.begin() + i, us.begin() + i + window)) > threshold)
+            return (int)i + 1;
+    }
+    return 0;
+}
+
+std::string RunQueueDepthBenchmark(OpenCLTest* ptr) {
+    static constexpr int maxDepth = 4096;
+    // median enqueue latency is reported per depth range [from, to]
+    static constexpr int ranges[][2] = { { 1, 16 }, { 17, 64 }, { 65, 256 }, { 257, 1024 }, { 1025, 4096 } };
+
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "#  device  backpressure_depth  median enqueue_us at depth 1-16 17-64 65-256 257-1K 1K-4K  growth\n";
+
+    int previous = ptr->selected;
+    for (int index = 0; index < (int)ptr->devices.size(); ++index) {
+        ptr->Select(index);
+        report << index << "  " << ptr->device.getInfo<CL_DEVICE_NAME>();
+        try {
+            TestQueueDepthClass tc(ptr);
+            tc.Prepare();
+            // warm up so the first launches don't pay for compilation and allocation
+            TimeRun(tc, 4);
+            auto events = tc.Run(maxDepth);
+            cl::WaitForEvents(events);
+            bool valid = tc.Verify();
+
+            int depth = BackPressureDepth(tc.enqueueUs);
+            if (depth)
+                report << "  " << depth;
+            else
+                report << "  none";
+
+            double first = 0, last = 0;
+            for (auto& range : ranges) {
+                double median = Median(std::vector<double>(tc.enqueueUs.begin() + range[0] - 1,
+                                                               tc.enqueueUs.begin() + range[1]));
+                if (range[0] == 1)
+                    first = median;
+                last = median;
+                report << "  " << median;
+            }
+            report << "  " << last / first << "x" << (valid ? "" : "  invalid") << "\n";
+        } catch(const cl::Error& e) {
+            std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+            report << "  failed: " << msg << "\n";
+        } catch(const JobCancelled&) {
+            ptr->Select(previous);
+            throw;
+        }
+        ReportProgress((index + 1.0) / ptr->devices.size(), report.str());
+    }
+    ptr->Select(previous);
+
+    report << "none = enqueue never blocked up to " << maxDepth << " outstanding launches\n";
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
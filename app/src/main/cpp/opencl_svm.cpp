@@ -0,0 +1,411 @@
+#include "opencl_test.h"
+
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+
+// Shared virtual memory.
+// Compares coarse-grained and fine-grained buffer SVM with plain cl::Buffer on
+// allocation, map/unmap, and pointer-rich structures: the cl::Buffer path has to turn
+// host pointers into indices and upload them, SVM hands the same pointers to the kernel.
+
+// Owns one clSVMAlloc allocation.
+struct SvmAllocation {
+    cl_context context = nullptr;
+    void* ptr = nullptr;
+
+    SvmAllocation(const cl::Context& ctx, cl_svm_mem_flags flags, size_t size)
+        : context(ctx()) {
+        ptr = clSVMAlloc(context, flags, size, 0);
+        if (!ptr)
+            throw cl::Error(CL_MEM_OBJECT_ALLOCATION_FAILURE, "clSVMAlloc");
+    }
+    SvmAllocation(const SvmAllocation&) = delete;
+    SvmAllocation& operator=(const SvmAllocation&) = delete;
+    ~SvmAllocation() {
+        if (ptr)
+            clSVMFree(context, ptr);
+    }
+};
+
+// Same layout as `Node` in the kernels, a list only uses `left` as its next pointer.
+struct SvmNode {
+    SvmNode* left;
+    SvmNode* right;
+    cl_int key;
+    cl_int value;
+};
+
+// What the cl::Buffer path has to serialize SvmNode into.
+struct IndexNode {
+    cl_int left;
+    cl_int right;
+    cl_int key;
+    cl_int value;
+};
+
+static constexpr const char* svmSrc = R"__(
+typedef struct Node {
+    global struct Node* left;
+    global struct Node* right;
+    int key;
+    int value;
+} Node;
+
+typedef struct IndexNode {
+    int left;
+    int right;
+    int key;
+    int value;
+} IndexNode;
+
+kernel void walk_list(global Node* pool, global const int* heads, global int* out) {
+    int gid = get_global_id(0);
+    int sum = 0;
+    for (global Node* n = pool + heads[gid]; n; n = n->left)
+        sum += n->value;
+    out[gid] = sum;
+}
+
+kernel void walk_list_idx(global const IndexNode* pool, global const int* heads, global int* out) {
+    int gid = get_global_id(0);
+    int sum = 0;
+    for (int n = heads[gid]; n >= 0; n = pool[n].left)
+        sum += pool[n].value;
+    out[gid] = sum;
+}
+
+kernel void walk_tree(global Node* pool, int root, int count, global int* out) {
+    int gid = get_global_id(0);
+    int key = (int)(((uint)gid * 2654435761u) % (uint)count);
+    global Node* n = pool + root;
+    while (n && n->key != key)
+        n = key < n->key ? n->left : n->right;
+    out[gid] = n ? n->value : -1;
+}
+
+kernel void walk_tree_idx(global const IndexNode* pool, int root, int count, global int* out) {
+    int gid = get_global_id(0);
+    int key = (int)(((uint)gid * 2654435761u) % (uint)count);
+    int n = root;
+    while (n >= 0 && pool[n].key != key)
+        n = key < pool[n].key ? pool[n].left : pool[n].right;
+    out[gid] = n >= 0 ? pool[n].value : -1;
+}
+)__";
+
+enum class SvmMode { Buffer, Coarse, Fine };
+
+static const char* SvmModeName(SvmMode mode) {
+    switch (mode) {
+        case SvmMode::Buffer: return "buffer";
+        case SvmMode::Coarse: return "coarse";
+        case SvmMode::Fine: return "fine";
+    }
+    return "";
+}
+
+struct SvmContext {
+    OpenCLTest* ptr;
+    cl::CommandQueue queue;
+    cl::Program prg;
+    cl_device_svm_capabilities caps;
+};
+
+using clock_type = std::chrono::high_resolution_clock;
+
+static double MsSince(clock_type::time_point start) {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+static void TestAllocation(SvmContext& svm, std::stringstream& report) {
+    static constexpr size_t sizes[] = { 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+    static constexpr int reps = 20;
+    cl_uint pattern = 0;
+
+    // allocation is timed up to the first device write, drivers often defer the real allocation
+    report << "alloc+touch+free us: size  buffer  coarse  fine\n";
+    for (auto size : sizes) {
+        report << size / 1024 << "K";
+
+        auto start = clock_type::now();
+        for (int i = 0; i < reps; ++i) {
+            CheckCancelled();
+            cl::Buffer buf(svm.ptr->context, CL_MEM_READ_WRITE, size);
+            svm.queue.enqueueFillBuffer(buf, pattern, 0, sizeof(pattern));
+            svm.queue.finish();
+        }
+        report << "  " << MsSince(start) * 1000.0 / reps;
+
+        for (auto flags : { (cl_svm_mem_flags)0, (cl_svm_mem_flags)CL_MEM_SVM_FINE_GRAIN_BUFFER }) {
+            if (flags && !(svm.caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER)) {
+                report << "  -";
+                continue;
+            }
+            start = clock_type::now();
+            for (int i = 0; i < reps; ++i) {
+                CheckCancelled();
+                SvmAllocation alloc(svm.ptr->context, CL_MEM_READ_WRITE | flags, size);
+                svm.queue.enqueueMemFillSVM((cl_uint*)alloc.ptr, pattern, sizeof(pattern));
+                svm.queue.finish();
+            }
+            report << "  " << MsSince(start) * 1000.0 / reps;
+        }
+        report << "\n";
+    }
+}
+
+static void TestMapUnmap(SvmContext& svm, std::stringstream& report) {
+    static constexpr size_t size = 1024 * 1024;
+    static constexpr int reps = 100;
+
+    report << "map+write+unmap 1M us: buffer  coarse  fine(no map)\n";
+
+    cl::Buffer buf(svm.ptr->context, CL_MEM_READ_WRITE, size);
+    auto start = clock_type::now();
+    for (int i = 0; i < reps; ++i) {
+        CheckCancelled();
+        auto p = (cl_uint*)svm.queue.enqueueMapBuffer(buf, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0, size);
+        p[0] = i;
+        svm.queue.enqueueUnmapMemObject(buf, p);
+    }
+    svm.queue.finish();
+    report << MsSince(start) * 1000.0 / reps;
+
+    CheckCancelled();
+    SvmAllocation coarse(svm.ptr->context, CL_MEM_READ_WRITE, size);
+    start = clock_type::now();
+    for (int i = 0; i < reps; ++i) {
+        svm.queue.enqueueMapSVM((cl_uint*)coarse.ptr, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, size);
+        ((cl_uint*)coarse.ptr)[0] = i;
+        svm.queue.enqueueUnmapSVM((cl_uint*)coarse.ptr);
+    }
+    svm.queue.finish();
+    report << "  " << MsSince(start) * 1000.0 / reps;
+
+    if (svm.caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER) {
+        SvmAllocation fine(svm.ptr->context, CL_MEM_READ_WRITE | CL_MEM_SVM_FINE_GRAIN_BUFFER, size);
+        start = clock_type::now();
+        for (int i = 0; i < reps; ++i) {
+            ((cl_uint*)fine.ptr)[0] = i;
+            // host writes are visible at the next synchronization point
+            svm.queue.finish();
+        }
+        report << "  " << MsSince(start) * 1000.0 / reps;
+    } else {
+        report << "  -";
+    }
+    report << "\n";
+}
+
+// A node pool in shuffled order so traversals chase pointers across the whole allocation.
+struct NodeGraph {
+    static constexpr int listCount = 4096;
+    static constexpr int listLength = 64;
+    static constexpr int treeSize = listCount * listLength;
+
+    std::vector<int> slot;         // logical node -> pool index
+    std::vector<cl_int> heads;     // pool index of each list head
+    int treeRoot = -1;
+
+    NodeGraph() {
+        slot.resize(treeSize);
+        std::iota(slot.begin(), slot.end(), 0);
+        std::mt19937 rand(12345);
+        std::shuffle(slot.begin(), slot.end(), rand);
+        heads.resize(listCount);
+        for (int l = 0; l < listCount; ++l)
+            heads[l] = slot[l * listLength];
+    }
+
+    void BuildList(SvmNode* pool) const {
+        for (int l = 0; l < listCount; ++l) {
+            for (int k = 0; k < listLength; ++k) {
+                auto& n = pool[slot[l * listLength + k]];
+                n.left = k + 1 < listLength ? &pool[slot[l * listLength + k + 1]] : nullptr;
+                n.right = nullptr;
+                n.key = k;
+                n.value = 1;
+            }
+        }
+    }
+
+    // balanced BST over keys [0, treeSize), logical node i holds key i
+    void BuildTree(SvmNode* pool) {
+        std::function<SvmNode*(int, int)> build = [&](int lo, int hi) -> SvmNode* {
+            if (lo >= hi)
+                return nullptr;
+            int mid = (lo + hi) / 2;
+            auto& n = pool[slot[mid]];
+            n.key = mid;
+            n.value = 1;
+            n.left = build(lo, mid);
+            n.right = build(mid + 1, hi);
+            return &n;
+        };
+        treeRoot = (int)(build(0, treeSize) - pool);
+    }
+
+    // the serialization step SVM is supposed to remove
+    static void Serialize(const SvmNode* pool, IndexNode* out) {
+        for (int i = 0; i < treeSize; ++i) {
+            out[i].left = pool[i].left ? (cl_int)(pool[i].left - pool) : -1;
+            out[i].right = pool[i].right ? (cl_int)(pool[i].right - pool) : -1;
+            out[i].key = pool[i].key;
+            out[i].value = pool[i].value;
+        }
+    }
+
+    static void Touch(SvmNode* pool, int iteration) {
+        for (int i = 0; i < treeSize; ++i)
+            pool[i].value = iteration;
+    }
+};
+
+// One frame: the host updates every node, a kernel traverses the structure, the host reads
+// the results back. Returns ms per frame.
+static double TestTraversal(SvmContext& svm, SvmMode mode, bool tree) {
+    static constexpr int frames = 10;
+    static constexpr size_t poolBytes = NodeGraph::treeSize * sizeof(SvmNode);
+    int work = tree ? NodeGraph::treeSize : NodeGraph::listCount;
+    size_t outBytes = work * sizeof(cl_int);
+
+    NodeGraph graph;
+    cl::Buffer headBuffer(svm.ptr->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                          graph.heads.size() * sizeof(cl_int), graph.heads.data());
+
+    if (mode == SvmMode::Buffer) {
+        std::vector<SvmNode> hostPool(NodeGraph::treeSize);
+        std::vector<IndexNode> serialized(NodeGraph::treeSize);
+        std::vector<cl_int> result(work);
+        tree ? graph.BuildTree(hostPool.data()) : graph.BuildList(hostPool.data());
+
+        cl::Buffer poolBuffer(svm.ptr->context, CL_MEM_READ_ONLY, NodeGraph::treeSize * sizeof(IndexNode));
+        cl::Buffer outBuffer(svm.ptr->context, CL_MEM_WRITE_ONLY, outBytes);
+        cl::Kernel kernel(svm.prg, tree ? "walk_tree_idx" : "walk_list_idx");
+        kernel.setArg(0, poolBuffer);
+        if (tree) {
+            kernel.setArg(1, graph.treeRoot);
+            kernel.setArg(2, NodeGraph::treeSize);
+            kernel.setArg(3, outBuffer);
+        } else {
+            kernel.setArg(1, headBuffer);
+            kernel.setArg(2, outBuffer);
+        }
+
+        auto start = clock_type::now();
+        for (int f = 0; f < frames; ++f) {
+            // the blocking read of the previous frame left the queue idle
+            CheckCancelled();
+            NodeGraph::Touch(hostPool.data(), f);
+            NodeGraph::Serialize(hostPool.data(), serialized.data());
+            svm.queue.enqueueWriteBuffer(poolBuffer, CL_FALSE, 0, serialized.size() * sizeof(IndexNode), serialized.data());
+            svm.queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(work));
+            svm.queue.enqueueReadBuffer(outBuffer, CL_TRUE, 0, outBytes, result.data());
+        }
+        return MsSince(start) / frames;
+    }
+
+    cl_svm_mem_flags flags = CL_MEM_READ_WRITE;
+    if (mode == SvmMode::Fine)
+        flags |= CL_MEM_SVM_FINE_GRAIN_BUFFER;
+    SvmAllocation pool(svm.ptr->context, flags, poolBytes);
+    SvmAllocation out(svm.ptr->context, flags, outBytes);
+    auto nodes = (SvmNode*)pool.ptr;
+    auto result = (cl_int*)out.ptr;
+
+    if (mode == SvmMode::Coarse)
+        svm.queue.enqueueMapSVM(nodes, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, poolBytes);
+    tree ? graph.BuildTree(nodes) : graph.BuildList(nodes);
+    if (mode == SvmMode::Coarse)
+        svm.queue.enqueueUnmapSVM(nodes);
+
+    cl::Kernel kernel(svm.prg, tree ? "walk_tree" : "walk_list");
+    kernel.setArg(0, nodes);
+    if (tree) {
+        kernel.setArg(1, graph.treeRoot);
+        kernel.setArg(2, NodeGraph::treeSize);
+        kernel.setArg(3, result);
+    } else {
+        kernel.setArg(1, headBuffer);
+        kernel.setArg(2, result);
+    }
+
+    auto start = clock_type::now();
+    for (int f = 0; f < frames; ++f) {
+        // every frame ends with a blocking map or finish, nothing uses the allocations here
+        CheckCancelled();
+        if (mode == SvmMode::Coarse)
+            svm.queue.enqueueMapSVM(nodes, CL_TRUE, CL_MAP_WRITE, poolBytes);
+        NodeGraph::Touch(nodes, f);
+        if (mode == SvmMode::Coarse)
+            svm.queue.enqueueUnmapSVM(nodes);
+        svm.queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(work));
+        if (mode == SvmMode::Coarse) {
+            svm.queue.enqueueMapSVM(result, CL_TRUE, CL_MAP_READ, outBytes);
+            svm.queue.enqueueUnmapSVM(result);
+        } else {
+            svm.queue.finish();
+        }
+    }
+    svm.queue.finish();
+    return MsSince(start) / frames;
+}
+
+std::string RunSvmBenchmark(OpenCLTest* ptr) {
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    SvmContext svm{ ptr, ptr->createQueue() };
+    try {
+        svm.caps = ptr->device.getInfo<CL_DEVICE_SVM_CAPABILITIES>();
+    } catch(const cl::Error& e) {
+        // OpenCL 1.x devices don't know the query
+        svm.caps = 0;
+    }
+    if (!(svm.caps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER)) {
+        report << "SVM not supported\n";
+        return report.str();
+    }
+    report << "svm caps:"
+           << (svm.caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER ? " fine-buffer" : "")
+           << (svm.caps & CL_DEVICE_SVM_FINE_GRAIN_SYSTEM ? " fine-system" : "")
+           << (svm.caps & CL_DEVICE_SVM_ATOMICS ? " atomics" : "") << "\n";
+
+    try {
+        TestAllocation(svm, report);
+        TestMapUnmap(svm, report);
+    } catch(const cl::Error& e) {
+        std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+        __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+        report << "failed: " << msg << "\n";
+    }
+
+    // device pointers stored in nodes must be the same width as host pointers
+    if (ptr->device.getInfo<CL_DEVICE_ADDRESS_BITS>() != sizeof(void*) * 8) {
+        report << "device address bits differ from host, pointer structures skipped\n";
+    } else {
+        try {
+            svm.prg = BuildProgram(ptr, svmSrc, "-cl-std=CL2.0");
+
+            report << "ms/frame  list  tree\n";
+            for (auto mode : { SvmMode::Buffer, SvmMode::Coarse, SvmMode::Fine }) {
+                if (mode == SvmMode::Fine && !(svm.caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER))
+                    continue;
+                double listMs = TestTraversal(svm, mode, false);
+                double treeMs = TestTraversal(svm, mode, true);
+                report << SvmModeName(mode) << "  " << listMs << "  " << treeMs << "\n";
+            }
+        } catch(const cl::Error& e) {
+            std::string msg = "[" + std::to_string(e.err()) + "]" + e.what();
+            __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", msg.c_str());
+            report << "failed: " << msg << "\n";
+        }
+    }
+
+    __android_log_write(ANDROID_LOG_INFO, "SORAYUKI", report.str().c_str());
+    return report.str();
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <android/log.h>
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_TARGET_OPENCL_VERSION 200
+// cl_khr_command_buffer is still a beta extension in the Khronos headers
+#define CL_ENABLE_BETA_EXTENSIONS
+#include <CL/opencl.hpp>
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct DeviceEntry {
+    cl::Platform platform;
+    cl::Device device;
+    cl::Context context;
+};
+
+struct OpenCLTest {
+    // the device tests currently run on, one of `devices`
+    cl::Platform platform;
+    cl::Device device;
+    cl::Context context;
+
+    // every device of every platform, each with its own context
+    std::vector<DeviceEntry> devices;
+    int selected = -1;
+
+    // Held by the JNI entry points while they touch the fields above. Jobs copy the
+    // selection under it and then run on that copy, so they never race with SelectDevice.
+    std::mutex mutex;
+
+    bool Select(int index) {
+        if (index < 0 || index >= (int)devices.size())
+            return false;
+        platform = devices[index].platform;
+        device = devices[index].device;
+        context = devices[index].context;
+        selected = index;
+        return true;
+    }
+
+    cl::CommandQueue createQueue(cl_command_queue_properties props = 0) {
+        return { context, device, props };
+    }
+};
+
+void fill_random(cl_uint* ptr, int count);
+void fill_random(cl_float* ptr, int count);
+
+// Builds a program from source, writing the build log to logcat if it fails.
+cl::Program BuildProgram(OpenCLTest* ptr, const std::string& src, const char* options = nullptr);
+
+// Device-side duration of a command enqueued on a CL_QUEUE_PROFILING_ENABLE queue.
+inline double ProfiledMs(const cl::Event& ev) {
+    auto start = ev.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    auto end = ev.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+    return (end - start) / 1000000.0;
+}
+
+struct TestCase {
+    OpenCLTest* ptr;
+    cl::CommandQueue queue;
+
+    TestCase(OpenCLTest* p, cl_command_queue_properties props = 0): ptr(p) {
+        queue = ptr->createQueue(props);
+    }
+
+    virtual ~TestCase();
+    virtual void Prepare() = 0;
+    virtual std::vector<cl::Event> Run(int loopCount) = 0;
+
+    // Records the commands of one Run iteration into a cl_khr_command_buffer.
+    // Returns false when the test has nothing that can be recorded.
+    virtual bool Record(cl::CommandBufferKhr& cmdbuf) { return false; }
+
+    // Checks on the device that the finished runs really produced their output.
+    // False means the timing can't be trusted, e.g. the driver dropped work.
+    virtual bool Verify() { return true; }
+
+    // Takes a buffer from BufferPool; it goes back to the pool when the test case is destroyed.
+    cl::Buffer AcquireBuffer(cl_mem_flags flags, size_t size);
+
+    // Called with every event right after Run enqueued it, before the next enqueue.
+    std::function<void(const cl::Event&)> onEnqueue;
+    // Run passes each event through this on its way into the returned list.
+    cl::Event Enqueued(cl::Event ev) {
+        if (onEnqueue)
+            onEnqueue(ev);
+        return ev;
+    }
+
+private:
+    std::vector<cl::Buffer> pooledBuffers;
+};
+
+// opencl_verify.cpp
+// Output buffers are filled with this before the test runs, so words a kernel never
+// wrote are found by DeviceMismatches.
+constexpr cl_uint verifySentinel = 0xDEADBEEF;
+// Position-dependent checksum of `count` 32-bit words, reduced on the device.
+cl_ulong DeviceChecksum(TestCase& tc, const cl::Buffer& buffer, size_t count);
+// Number of 32-bit words equal to `sentinel`, or with period != 0, different from word
+// i % period. Counted on the device; a non-zero result is logged.
+cl_uint DeviceMismatches(TestCase& tc, const cl::Buffer& buffer, size_t count, cl_uint sentinel, cl_uint period = 0);
+// Drops the verification program built for a context.
+void ClearVerifyPrograms(const cl::Context& context);
+
+// return: cost in milliseconds, NaN when a test case failed verification
+template<class T>
+double RunTest(OpenCLTest* ptr, int parallelCount, int loopCount) {
+    if (parallelCount <= 0)
+        parallelCount = 1;
+
+    std::vector<std::optional<T>> testcases(parallelCount);
+    for (auto &tc : testcases) {
+        tc = {{ ptr }};
+        tc->Prepare();
+    }
+
+    using clock = std::chrono::high_resolution_clock;
+    auto start = clock::now();
+
+    std::vector<cl::Event> allEvents;
+    for (int i = 0; i < parallelCount; ++i) {
+        auto evs = testcases[i]->Run(loopCount);
+        allEvents.insert(allEvents.end(), evs.begin(), evs.end());
+    }
+
+    if (allEvents.empty()) {
+        __android_log_write(ANDROID_LOG_WARN, "SORAYUKI", "No OpenCL events captured; returning 0 ms");
+        return 0.0;
+    }
+
+    cl::WaitForEvents(allEvents);
+    auto finished = clock::now();
+
+    for (auto& tc : testcases) {
+        if (!tc->Verify())
+            return std::numeric_limits<double>::quiet_NaN();
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(finished - start).count();
+}
+
+// opencl_cmdbuf.cpp
+// Queue properties a device wants for command-buffer recording, or nullopt if
+// cl_khr_command_buffer is not available.
+std::optional<cl_command_queue_properties> CommandBufferQueueProperties(OpenCLTest* ptr);
+// Records one iteration of tc and finalizes it; returns an empty object when the extension
+// is missing or the test can't be recorded.
+cl::CommandBufferKhr RecordCommandBuffer(TestCase& tc);
+// Replays cmdbuf loopCount times when valid, otherwise falls back to tc.Run(loopCount).
+std::vector<cl::Event> ReplayRun(TestCase& tc, cl::CommandBufferKhr& cmdbuf, int loopCount);
+
+// Host wall time of one Run(loopCount) until every returned event completes, in milliseconds.
+// Unlike RunTest this keeps sub-millisecond precision, for benchmarks made of short launches.
+inline double TimeRun(TestCase& tc, int loopCount) {
+    using clock = std::chrono::high_resolution_clock;
+    auto start = clock::now();
+    auto events = tc.Run(loopCount);
+    if (!events.empty())
+        cl::WaitForEvents(events);
+    auto finished = clock::now();
+    return std::chrono::duration<double, std::milli>(finished - start).count();
+}
+
+// Runs the "copy" (MB/s) or "flops" (FLOPS) test on the selected device, 0 for unknown tests
+// and NaN when the result failed verification.
+double RunComputeTest(OpenCLTest* ptr, const char* type);
+// Runs one of the report benchmarks below by name.
+std::string RunReportTest(OpenCLTest* ptr, const char* type);
+
+// opencl_jobs.cpp
+// Benchmarks started through the job runner run on a native worker thread. They call these
+// between enqueues; on any other thread both do nothing.
+struct JobCancelled : std::exception {
+    const char* what() const noexcept override { return "job cancelled"; }
+};
+// Throws JobCancelled once the job running on this thread was cancelled.
+void CheckCancelled();
+// Posts progress in [0, 1] and an optional partial result to the job's listener.
+void ReportProgress(double fraction, const std::string& partial = {});
+// Cancels and joins every job of ptr, before it is deleted.
+void StopJobs(OpenCLTest* ptr);
+
+// Benchmarks below produce a multi-line text report instead of a single number.
+// They are reached through OpenCLTest.TestReport on the Java side.
+
+// opencl_occupancy.cpp
+std::string RunOccupancySweep(OpenCLTest* ptr);
+// opencl_dag.cpp
+std::string RunDagBenchmark(OpenCLTest* ptr);
+// opencl_cmdbuf.cpp
+std::string RunCommandBufferBenchmark(OpenCLTest* ptr);
+// opencl_argcache.cpp
+std::string RunArgCacheBenchmark(OpenCLTest* ptr);
+// opencl_svm.cpp
+std::string RunSvmBenchmark(OpenCLTest* ptr);
+// opencl_buffer_pool.cpp
+std::string RunBufferPoolBenchmark(OpenCLTest* ptr);
+// opencl_multidevice.cpp
+// `subset` is a comma separated list of device indices, empty for every device.
+std::string RunDeviceSuite(OpenCLTest* ptr, const std::string& subset);
+std::string RunSplitBenchmark(OpenCLTest* ptr);
+// opencl_fission.cpp
+std::string RunFissionBenchmark(OpenCLTest* ptr);
+// opencl_completion.cpp
+std::string RunCompletionBenchmark(OpenCLTest* ptr);
+// opencl_queuedepth.cpp
+std::string RunQueueDepthBenchmark(OpenCLTest* ptr);
+// gles_compute.cpp
+std::string RunGLComputeBenchmark(OpenCLTest* ptr);
+// gles_interference.cpp
+std::string RunInterferenceBenchmark(OpenCLTest* ptr);
+// opencl_history.cpp
+std::string RunHistoryReport(OpenCLTest* ptr);
@@ -0,0 +1,263 @@
+#pragma once
+
+#include "opencl_test.h"
+#include "cached_kernel_functor.h"
+
+struct TestCopyClass: TestCase {
+    using TestCase::TestCase;
+
+    static constexpr size_t MB = 1048576;
+    static constexpr size_t BUFFER_SIZE = 2; // in uint32_t count
+    static constexpr size_t VECSIZE = 16;
+
+    cl::Buffer sourceBuffer;
+    cl::Buffer dstBuffer;
+    cl::Program prg;
+    cl::Kernel recordedKernel;
+    bool useKernel = true;
+    // bind kernel arguments once instead of on every launch
+    bool cachedArgs = false;
+    std::optional<CachedKernelFunctor<cl::Buffer, cl::Buffer>> cachedKernel;
+
+    static constexpr const char* src = R"__(
+        kernel void copy_buffer(global uint16* input, global uint16* output) {
+            int gid = get_global_linear_id();
+            output[gid] = input[gid];
+        }
+    )__";
+
+    void Prepare() override {
+        try {
+            sourceBuffer = AcquireBuffer(CL_MEM_READ_ONLY, BUFFER_SIZE * MB * sizeof(cl_uint16));
+            auto pBuffer = (uint32_t*)queue.enqueueMapBuffer(sourceBuffer, true, CL_MAP_WRITE_INVALIDATE_REGION, 0, BUFFER_SIZE * MB * sizeof(cl_uint16));
+            fill_random(pBuffer, BUFFER_SIZE * MB * VECSIZE);
+            queue.enqueueUnmapMemObject(sourceBuffer, pBuffer);
+            dstBuffer = AcquireBuffer(CL_MEM_READ_WRITE, BUFFER_SIZE * MB * sizeof(cl_uint16));
+            // a pooled buffer may still hold an earlier copy of the same data
+            queue.enqueueFillBuffer(dstBuffer, verifySentinel, 0, BUFFER_SIZE * MB * sizeof(cl_uint16));
+            // the upload and the fill must not land in the timed runs
+            queue.finish();
+
+            prg = cl::Program(ptr->context, src, true);
+        } catch(const cl::BuildError& e) {
+            for(auto& x: e.getBuildLog()) {
+                __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", x.second.c_str());
+            }
+        }
+    }
+
+    std::vector<cl::Event> Run(int loopCount) override {
+        std::vector<cl::Event> events;
+        events.reserve(loopCount);
+        // only the functor this mode launches, creating a cl::Kernel isn't free
+        std::optional<cl::KernelFunctor<cl::Buffer, cl::Buffer>> copyBuffer;
+        if (useKernel && cachedArgs && !cachedKernel)
+            cachedKernel.emplace(prg, "copy_buffer");
+        else if (useKernel && !cachedArgs)
+            copyBuffer.emplace(prg, "copy_buffer");
+
+        for (int i = 0; i < loopCount; ++i) {
+            CheckCancelled();
+            if (useKernel && cachedArgs)
+                events.push_back(Enqueued((*cachedKernel)(queue, cl::NDRange(BUFFER_SIZE, MB), sourceBuffer, dstBuffer)));
+            else if (useKernel)
+                events.push_back(Enqueued((*copyBuffer)(cl::EnqueueArgs(queue, cl::NDRange(BUFFER_SIZE, MB)), sourceBuffer, dstBuffer)));
+            else {
+                cl::Event ev;
+                queue.enqueueCopyBuffer(sourceBuffer, dstBuffer, 0, 0, BUFFER_SIZE * MB * sizeof(cl_uint16), nullptr, &ev);
+                events.push_back(Enqueued(ev));
+            }
+        }
+        return events;
+    }
+
+    bool Record(cl::CommandBufferKhr& cmdbuf) override {
+        if (useKernel) {
+            recordedKernel = cl::Kernel(prg, "copy_buffer");
+            recordedKernel.setArg(0, sourceBuffer);
+            recordedKernel.setArg(1, dstBuffer);
+            cmdbuf.commandNDRangeKernel({ 0 }, recordedKernel, cl::NullRange, cl::NDRange(BUFFER_SIZE, MB));
+        } else {
+            cmdbuf.commandCopyBuffer(sourceBuffer, dstBuffer, 0, 0, BUFFER_SIZE * MB * sizeof(cl_uint16));
+        }
+        return true;
+    }
+
+    bool Verify() override {
+        size_t words = BUFFER_SIZE * MB * VECSIZE;
+        if (DeviceChecksum(*this, sourceBuffer, words) == DeviceChecksum(*this, dstBuffer, words))
+            return true;
+        __android_log_write(ANDROID_LOG_WARN, "SORAYUKI", "verification failed: copy checksum mismatch");
+        return false;
+    }
+};
+
+
+struct TestFlopsClass: TestCase {
+    using TestCase::TestCase;
+
+    cl::Program prg;
+    cl::Kernel recordedKernel;
+    cl::Buffer outBuffer;
+    
+    static constexpr int globalSize = 2048 * 2048; 
+    static constexpr int innerLoop = 3000;
+
+    static constexpr const char* src = R"__(
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+kernel void compute_flops(global half* outbuf, int loops) {
+    int id = get_global_linear_id();
+    
+    // Using half16 to maximize register usage and mimic matrix-mul workload
+    // Adreno 840 likely has specialized DOT product / Tensor units
+    // Initialize with runtime ID to prevent optimization
+    half val = (half)(id & 0xFF) * 0.001h;
+    
+    half16 a = (half16)(val);
+    half16 b = (half16)(1.001h);
+    half16 c = (half16)(0.5h);
+    
+    // Accumulators for dot product results
+    half4 sum0 = (half4)(0.0h);
+    half4 sum1 = (half4)(0.0h);
+    half4 sum2 = (half4)(0.0h);
+    half4 sum3 = (half4)(0.0h);
+
+    for(int i = 0; i < loops; ++i) {
+        // Mimic the math intensity of a 4x4 matrix multiplication or convolution
+        // Use standard 'dot' built-in which maps to hardware dot-product/tensor units efficiently
+        // Each dot(half4, half4) is considered 8 ops (4 muls + 4 adds convention for peak FLOPs counting)
+        
+        // We perform dots across various swizzles to keep execution ports busy and simulate dependencies
+        // 16 dots per unroll block
+        
+        sum0.x += dot(a.lo.lo, b.lo.lo) + dot(a.lo.hi, b.lo.hi);
+        sum0.y += dot(a.hi.lo, b.hi.lo) + dot(a.hi.hi, b.hi.hi);
+        sum0.z += dot(a.lo.lo, b.hi.lo) + dot(a.lo.hi, b.hi.hi);
+        sum0.w += dot(a.hi.lo, b.lo.lo) + dot(a.hi.hi, b.lo.hi);
+        
+        sum1.x += dot(a.lo.lo, c.lo.lo) + dot(a.lo.hi, c.lo.hi);
+        sum1.y += dot(a.hi.lo, c.hi.lo) + dot(a.hi.hi, c.hi.hi);
+        sum1.z += dot(a.lo.lo, c.hi.lo) + dot(a.lo.hi, c.hi.hi);
+        sum1.w += dot(a.hi.lo, c.lo.lo) + dot(a.hi.hi, c.lo.hi);
+        
+        // Mutate 'a' to prevent loop invariants being lifted (though dot result accumulation helps)
+        a += (half16)(0.0001h);
+        
+        // Another block
+        sum2.x += dot(a.even.even, b.odd.odd) + dot(a.odd.even, b.even.odd);
+        sum2.y += dot(a.even.odd, b.odd.even) + dot(a.odd.odd, b.even.even);
+        sum2.z += dot(a.lo.lo, b.hi.hi) + dot(a.hi.hi, b.lo.lo);
+        sum2.w += dot(a.s0123, b.s3210) + dot(a.s4567, b.s7654); // swizzle fun
+        
+        sum3.x += dot(a.lo.lo, c.lo.lo) + dot(a.lo.hi, c.lo.hi);
+        sum3.y += dot(a.hi.lo, c.hi.lo) + dot(a.hi.hi, c.hi.hi);
+        sum3.z += dot(a.lo.lo, c.hi.lo) + dot(a.lo.hi, c.hi.hi);
+        sum3.w += dot(a.hi.lo, c.lo.lo) + dot(a.hi.hi, c.lo.hi);
+        
+        // Total: 32 dot products per loop
+    }
+    
+    half4 total = sum0 + sum1 + sum2 + sum3;
+    outbuf[id] = total.x + total.y + total.z + total.w;
+}
+)__";
+
+    void Prepare() override {
+        try {
+            // 只分配一个输出buffer防止被优化掉
+            outBuffer = AcquireBuffer(CL_MEM_READ_WRITE, globalSize * sizeof(cl_half));
+            queue.enqueueFillBuffer(outBuffer, verifySentinel, 0, globalSize * sizeof(cl_half));
+            queue.finish();
+            prg = cl::Program(ptr->context, src, true);
+        } catch(const cl::BuildError& e) {
+            for(auto& x: e.getBuildLog()) {
+                __android_log_write(ANDROID_LOG_ERROR, "SORAYUKI", x.second.c_str());
+            }
+        }
+    }
+
+    std::vector<cl::Event> Run(int loopCount) override {
+        std::vector<cl::Event> events;
+        events.reserve(loopCount);
+        cl::KernelFunctor<cl::Buffer, int> compute_flops(prg, "compute_flops");
+
+        for(int it = 0; it < loopCount; ++it) {
+            CheckCancelled();
+            events.push_back(Enqueued(compute_flops(cl::EnqueueArgs(queue, cl::NDRange(globalSize)), outBuffer, innerLoop)));
+        }
+        return events;
+    }
+
+    bool Record(cl::CommandBufferKhr& cmdbuf) override {
+        recordedKernel = cl::Kernel(prg, "compute_flops");
+        recordedKernel.setArg(0, outBuffer);
+        recordedKernel.setArg(1, innerLoop);
+        cmdbuf.commandNDRangeKernel({ 0 }, recordedKernel, cl::NullRange, cl::NDRange(globalSize));
+        return true;
+    }
+
+    bool Verify() override {
+        // the result only depends on id & 0xFF: 256 halves repeat every 128 words
+        return DeviceMismatches(*this, outBuffer, globalSize / 2, verifySentinel, 128) == 0;
+    }
+};
+
+// Launch overhead probe: a kernel so small that the host side of each enqueue dominates.
+struct TestLaunchClass: TestCase {
+    using TestCase::TestCase;
+
+    static constexpr int globalSize = 1024;
+
+    cl::Buffer buffer;
+    cl::Program prg;
+    cl::Kernel recordedKernel;
+    bool cachedArgs = false;
+    std::optional<CachedKernelFunctor<cl::Buffer, cl_uint>> cachedKernel;
+
+    static constexpr const char* src = R"__(
+        kernel void tiny_kernel(global uint* data, uint value) {
+            int gid = get_global_linear_id();
+            data[gid] += value;
+        }
+    )__";
+
+    void Prepare() override {
+        buffer = cl::Buffer(ptr->context, CL_MEM_READ_WRITE, globalSize * sizeof(cl_uint));
+        queue.enqueueFillBuffer(buffer, (cl_uint)0, 0, globalSize * sizeof(cl_uint));
+        queue.finish();
+        prg = BuildProgram(ptr, src);
+    }
+
+    std::vector<cl::Event> Run(int loopCount) override {
+        std::vector<cl::Event> events;
+        events.reserve(loopCount);
+        std::optional<cl::KernelFunctor<cl::Buffer, cl_uint>> tinyKernel;
+        if (cachedArgs && !cachedKernel)
+            cachedKernel.emplace(prg, "tiny_kernel");
+        else if (!cachedArgs)
+            tinyKernel.emplace(prg, "tiny_kernel");
+
+        for (int i = 0; i < loopCount; ++i) {
+            CheckCancelled();
+            if (cachedArgs)
+                events.push_back(Enqueued((*cachedKernel)(queue, cl::NDRange(globalSize), buffer, 1u)));
+            else
+                events.push_back(Enqueued((*tinyKernel)(cl::EnqueueArgs(queue, cl::NDRange(globalSize)), buffer, 1u)));
+        }
+        return events;
+    }
+
+    bool Record(cl::CommandBufferKhr& cmdbuf) override {
+        recordedKernel = cl::Kernel(prg, "tiny_kernel");
+        recordedKernel.setArg(0, buffer);
+        recordedKernel.setArg(1, 1u);
+        cmdbuf.commandNDRangeKernel({ 0 }, recordedKernel, cl::NullRange, cl::NDRange(globalSize));
+        return true;
+    }
+
+    bool Verify() override {
+        // every element was incremented once per launch, so all are equal and non-zero
+        return DeviceMismatches(*this, buffer, globalSize, 0, 1) == 0;
+    }
+};
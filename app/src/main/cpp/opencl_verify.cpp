@@ -0,0 +1,109 @@
+#include "opencl_test.h"
+
+#include <map>
+#include <mutex>
+
+// Device-side result verification.
+// Both checks reduce on the device and read back a few words only, so verifying a test
+// that wrote hundreds of MB doesn't add a readback that would distort its timing.
+
+static constexpr int verifyGroupSize = 256;
+static constexpr int verifyGroups = 64;
+
+static constexpr const char* verifySrc = R"__(
+uint mix32(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// position-dependent, order-independent: one partial sum per work-group
+kernel void checksum(global const uint* data, uint count, global ulong* partial, local ulong* scratch) {
+    uint lid = get_local_id(0);
+    ulong acc = 0;
+    for (uint i = get_global_id(0); i < count; i += get_global_size(0))
+        acc += mix32(data[i] ^ mix32(i));
+    scratch[lid] = acc;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (uint s = get_local_size(0) / 2; s > 0; s >>= 1) {
+        if (lid < s)
+            scratch[lid] += scratch[lid + s];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0)
+        partial[get_group_id(0)] = scratch[0];
+}
+
+kernel void mismatches(global const uint* data, uint count, uint sentinel, uint period,
+                       global uint* result) {
+    uint n = 0;
+    for (uint i = get_global_id(0); i < count; i += get_global_size(0)) {
+        uint v = data[i];
+        if (v == sentinel || (period && v != data[i % period]))
+            ++n;
+    }
+    if (n)
+        atomic_add(result, n);
+}
+)__";
+
+static std::mutex g_verifyMutex;
+// built once per context; a cached program retains its context, so the key stays unique
+static std::map<cl_context, cl::Program> g_verifyPrograms;
+
+static cl::Program VerifyProgram(OpenCLTest* ptr) {
+    std::lock_guard<std::mutex> lock(g_verifyMutex);
+    auto it = g_verifyPrograms.find(ptr->context());
+    if (it != g_verifyPrograms.end())
+        return it->second;
+    auto prg = BuildProgram(ptr, verifySrc);
+    g_verifyPrograms[ptr->context()] = prg;
+    return prg;
+}
+
+void ClearVerifyPrograms(const cl::Context& context) {
+    std::lock_guard<std::mutex> lock(g_verifyMutex);
+    g_verifyPrograms.erase(context());
+}
+
+cl_ulong DeviceChecksum(TestCase& tc, const cl::Buffer& buffer, size_t count) {
+    cl::Kernel kernel(VerifyProgram(tc.ptr), "checksum");
+    cl::Buffer partial(tc.ptr->context, CL_MEM_WRITE_ONLY, verifyGroups * sizeof(cl_ulong));
+    kernel.setArg(0, buffer);
+    kernel.setArg(1, (cl_uint)count);
+    kernel.setArg(2, partial);
+    kernel.setArg(3, cl::Local(verifyGroupSize * sizeof(cl_ulong)));
+    tc.queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(verifyGroups * verifyGroupSize),
+                                  cl::NDRange(verifyGroupSize));
+
+    cl_ulong sums[verifyGroups];
+    tc.queue.enqueueReadBuffer(partial, true, 0, sizeof(sums), sums);
+    cl_ulong total = 0;
+    for (auto s : sums)
+        total += s;
+    return total;
+}
+
+cl_uint DeviceMismatches(TestCase& tc, const cl::Buffer& buffer, size_t count, cl_uint sentinel, cl_uint period) {
+    cl::Kernel kernel(VerifyProgram(tc.ptr), "mismatches");
+    cl_uint zero = 0;
+    cl::Buffer result(tc.ptr->context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint), &zero);
+    kernel.setArg(0, buffer);
+    kernel.setArg(1, (cl_uint)count);
+    kernel.setArg(2, sentinel);
+    kernel.setArg(3, period);
+    kernel.setArg(4, result);
+    tc.queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(verifyGroups * verifyGroupSize),
+                                  cl::NDRange(verifyGroupSize));
+
+    cl_uint n = 0;
+    tc.queue.enqueueReadBuffer(result, true, 0, sizeof(n), &n);
+    if (n) {
+        std::string msg = "verification failed: " + std::to_string(n) + " of " + std::to_string(count) + " words";
+        __android_log_write(ANDROID_LOG_WARN, "SORAYUKI", msg.c_str());
+    }
+    return n;
+}
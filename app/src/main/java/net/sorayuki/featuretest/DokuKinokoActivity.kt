@@ -5,11 +5,13 @@ import android.view.Surface
 import android.view.SurfaceHolder
 import android.view.SurfaceView
 import android.widget.Button
+import android.widget.Spinner
 import android.widget.TextView
 import androidx.activity.enableEdgeToEdge
 import androidx.appcompat.app.AppCompatActivity
 import androidx.core.view.ViewCompat
 import androidx.core.view.WindowInsetsCompat
+import java.util.concurrent.ConcurrentLinkedQueue
 import java.util.concurrent.atomic.AtomicBoolean
 
 class DokuKinokoActivity : AppCompatActivity(), SurfaceHolder.Callback {
@@ -24,6 +26,10 @@ class DokuKinokoActivity : AppCompatActivity(), SurfaceHolder.Callback {
     
     private val lastFps = DoubleArray(3) { 0.0 }
     private lateinit var fpsTextView: TextView
+    private lateinit var reportTextView: TextView
+
+    // Native calls that need the GL context, run by the render thread between frames
+    private val renderTasks = ConcurrentLinkedQueue<() -> Unit>()
 
     companion object {
         init {
@@ -31,10 +37,14 @@ class DokuKinokoActivity : AppCompatActivity(), SurfaceHolder.Callback {
         }
     }
 
-    external fun nativeInit(surface: Surface)
+    external fun nativeInit(surface: Surface, cacheDir: String)
     external fun nativeResize(width: Int, height: Int)
     external fun nativeRender()
     external fun nativeDestroy()
+    external fun nativeSetOption(option: String): Boolean
+    external fun nativeReport(name: String): String
+    // GPU ms of the ray march and the blit of a recent frame
+    external fun nativeGpuTimes(): DoubleArray
 
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
@@ -55,6 +65,27 @@ class DokuKinokoActivity : AppCompatActivity(), SurfaceHolder.Callback {
         findViewById<Button>(R.id.StartKinoko).setOnClickListener {
             startRendering()
         }
+
+        reportTextView = findViewById(R.id.KinokoReportText)
+
+        findViewById<Button>(R.id.KinokoApplyOption).setOnClickListener {
+            val option = findViewById<Spinner>(R.id.KinokoOptionSpinner).selectedItem as String
+            runOnRenderThread {
+                val applied = nativeSetOption(option)
+                runOnUiThread {
+                    reportTextView.text = if (applied) "$option: applied" else "$option: not supported"
+                }
+            }
+        }
+
+        findViewById<Button>(R.id.KinokoRunReport).setOnClickListener {
+            val name = findViewById<Spinner>(R.id.KinokoReportSpinner).selectedItem as String
+            reportTextView.text = "$name: running"
+            runOnRenderThread {
+                val result = nativeReport(name)
+                runOnUiThread { reportTextView.text = result }
+            }
+        }
     }
 
     override fun onPause() {
@@ -69,7 +100,7 @@ class DokuKinokoActivity : AppCompatActivity(), SurfaceHolder.Callback {
         val surface = findViewById<SurfaceView>(R.id.KinokoSurface).holder.surface
         
         renderThread = Thread {
-            nativeInit(surface)
+            nativeInit(surface, cacheDir.absolutePath)
             
             // Force initial resize
             nativeResize(surfaceWidth, surfaceHeight)
@@ -83,6 +114,11 @@ class DokuKinokoActivity : AppCompatActivity(), SurfaceHolder.Callback {
                     sizeChanged = false
                 }
 
+                while (true) {
+                    val task = renderTasks.poll() ?: break
+                    task()
+                }
+
                 nativeRender()
 
                 val now = System.nanoTime()
@@ -91,14 +127,23 @@ class DokuKinokoActivity : AppCompatActivity(), SurfaceHolder.Callback {
                 
                 if (diff > 0) {
                     val fps = 1_000_000_000.0 / diff
-                    updateFps(fps)
+                    updateFps(fps, nativeGpuTimes())
                 }
             }
+            renderTasks.clear()
             nativeDestroy()
         }
         renderThread?.start()
     }
 
+    private fun runOnRenderThread(task: () -> Unit) {
+        if (!isRunning.get()) {
+            reportTextView.text = "press Start first"
+            return
+        }
+        renderTasks.add(task)
+    }
+
     private fun stopRendering() {
         if (!isRunning.get()) return
         isRunning.set(false)
@@ -110,7 +155,7 @@ class DokuKinokoActivity : AppCompatActivity(), SurfaceHolder.Callback {
         renderThread = null
     }
 
-    private fun updateFps(currentFps: Double) {
+    private fun updateFps(currentFps: Double, gpuMs: DoubleArray) {
         // Shift values: [0] is newest
         lastFps[2] = lastFps[1]
         lastFps[1] = lastFps[0]
@@ -120,7 +165,8 @@ class DokuKinokoActivity : AppCompatActivity(), SurfaceHolder.Callback {
         val weightedFps = (lastFps[0] * 4.0 + lastFps[1] * 2.0 + lastFps[2] * 1.0) / 7.0
 
         runOnUiThread {
-            fpsTextView.text = String.format("FPS: %.2f", weightedFps)
+            fpsTextView.text = String.format("FPS: %.2f  GPU march %.2f ms, blit %.2f ms",
+                weightedFps, gpuMs[0], gpuMs[1])
         }
     }
 
@@ -5,6 +5,8 @@ import android.os.Handler
 import android.os.HandlerThread
 import android.os.Looper
 import android.view.View
+import android.widget.AdapterView
+import android.widget.ArrayAdapter
 import androidx.activity.enableEdgeToEdge
 import androidx.appcompat.app.AppCompatActivity
 import androidx.core.view.ViewCompat
@@ -19,6 +21,7 @@ class OpenCLTestActivity : AppCompatActivity() {
     private lateinit var bgHandler: Handler
 
     lateinit var cl: OpenCLTest
+    private var reportJob = 0L
 
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
@@ -41,23 +44,44 @@ class OpenCLTestActivity : AppCompatActivity() {
 
         bgHandler.post {
             cl = OpenCLTest()
+            cl.OpenHistory(filesDir.absolutePath + "/results.bin")
             if (cl.Init(cl.self)) {
                 val devName = cl.QueryString(cl.self, "device_name")
                 val platName = cl.QueryString(cl.self, "platform_name")
+                val devices = cl.QueryString(cl.self, "device_list").trim().split("\n")
                 fgHandler.post {
                     binding.clDeviceName.text = devName
                     binding.clPlatformName.text = platName
+                    binding.clDeviceSpinner.adapter = ArrayAdapter(this, android.R.layout.simple_spinner_dropdown_item, devices)
+                    binding.clDeviceSpinner.setSelection(devices.indexOfFirst { it.endsWith("(GPU)") }.coerceAtLeast(0), false)
                     binding.mainOpLayout.visibility = View.VISIBLE
                 }
             }
         }
 
+        binding.clDeviceSpinner.onItemSelectedListener = object : AdapterView.OnItemSelectedListener {
+            override fun onItemSelected(parent: AdapterView<*>?, view: View?, position: Int, id: Long) {
+                bgHandler.post {
+                    if (cl.SelectDevice(cl.self, position)) {
+                        val devName = cl.QueryString(cl.self, "device_name")
+                        val platName = cl.QueryString(cl.self, "platform_name")
+                        fgHandler.post {
+                            binding.clDeviceName.text = devName
+                            binding.clPlatformName.text = platName
+                        }
+                    }
+                }
+            }
+
+            override fun onNothingSelected(parent: AdapterView<*>?) {}
+        }
+
         binding.testKernelCopy.setOnClickListener {
             it.isEnabled = false
             bgHandler.post {
                 val speed = cl.TestCompute(cl.self, "copy")
                 fgHandler.post {
-                    binding.testD2DResult.text = "%.2f MB/s".format(speed)
+                    binding.testD2DResult.text = if (speed.isNaN()) "invalid" else "%.2f MB/s".format(speed)
                     it.isEnabled = true
                 }
             }
@@ -68,17 +92,50 @@ class OpenCLTestActivity : AppCompatActivity() {
             bgHandler.post {
                 val speed = cl.TestCompute(cl.self, "flops")
                 fgHandler.post {
-                    binding.testFlopsResult.text = "%.2f GFLOPS".format(speed / 1000000000.0)
+                    binding.testFlopsResult.text = if (speed.isNaN()) "invalid" else "%.2f GFLOPS".format(speed / 1000000000.0)
                     it.isEnabled = true
                 }
             }
         }
 
+        binding.runReportTest.setOnClickListener {
+            if (reportJob != 0L) {
+                cl.CancelJob(reportJob)
+                it.isEnabled = false
+                return@setOnClickListener
+            }
+            val testName = binding.reportTestSpinner.selectedItem as String
+            binding.reportText.text = "$testName: running"
+            binding.runReportTest.text = "Cancel"
+            reportJob = cl.StartJob(cl.self, testName, object : JobListener {
+                override fun onJobProgress(handle: Long, fraction: Double, partial: String) {
+                    fgHandler.post {
+                        binding.reportText.text = "$testName: %.0f%%\n%s".format(fraction * 100.0, partial)
+                    }
+                }
+
+                override fun onJobFinished(handle: Long, result: String, cancelled: Boolean) {
+                    fgHandler.post {
+                        binding.reportText.text = if (cancelled) "$testName: cancelled" else result
+                        binding.runReportTest.text = "Run"
+                        binding.runReportTest.isEnabled = true
+                        reportJob = 0L
+                    }
+                }
+            })
+        }
+
         binding.devExtsBtn.setOnClickListener { binding.extensionText.text = cl.QueryString(cl.self, "device_exts").replace(" ", "\n") }
         binding.platExtsBtn.setOnClickListener { binding.extensionText.text = cl.QueryString(cl.self, "platform_exts").replace(" ", "\n") }
     }
 }
 
+// Called on the job's native thread.
+interface JobListener {
+    fun onJobProgress(handle: Long, fraction: Double, partial: String)
+    fun onJobFinished(handle: Long, result: String, cancelled: Boolean)
+}
+
 class OpenCLTest: Closeable {
     init {
         System.loadLibrary("featuretest")
@@ -104,6 +161,11 @@ class OpenCLTest: Closeable {
     external fun Create(): Long
     external fun Delete(self: Long)
     external fun Init(self: Long): Boolean
+    external fun SelectDevice(self: Long, index: Int): Boolean
     external fun QueryString(self: Long, key: String): String
     external fun TestCompute(self: Long, type: String): Double
+    external fun TestReport(self: Long, type: String): String
+    external fun StartJob(self: Long, type: String, listener: JobListener): Long
+    external fun CancelJob(handle: Long)
+    external fun OpenHistory(path: String): Boolean
 }
\ No newline at end of file